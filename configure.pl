@@ -46,7 +46,8 @@ use Cwd qw(cwd chdir);
 #####
 # Global Variables
 use vars qw{$opt_help $opt_bundle $opt_developer $opt_prefix $opt_bindir
-			$opt_incdir $opt_incdir $opt_libdir $opt_cxx $opt_disable_shared};
+			$opt_incdir $opt_incdir $opt_libdir $opt_cxx $opt_disable_shared
+			$opt_atomic_refcount};
 
 # Possible names for the compiler
 my @cxx_guess = qw(g++ c++ CC cl bcc32);
@@ -71,6 +72,8 @@ my $mkmf_flags  = "--cxxflags '$cxxflags' --quiet ";
 
 my $libname	= "tpt";
 my $install_spec= "doc/install.spec";
+my $config_h	= "inc/libtpt/tptconfig.h";
+my $config_h_in	= "src/lib/tptconfig.h.in";
 
 my $includes	= "--include '${cwd}/inc' ";
 my $libraries	= "--slinkwith '${cwd}/src/lib,$libname' ";
@@ -95,7 +98,8 @@ GetOptions(
 	'bindir=s',
 	'incdir=s',
 	'libdir=s',
-	'cxx=s'
+	'cxx=s',
+	'atomic-refcount'	# count Object references atomically
 ) or usage();
 $opt_help && usage();
 
@@ -110,6 +114,8 @@ sub usage {
   --libdir path      Set the install lib dir to path [PREFIX/lib]
   --cxx    path      Specify the path to your C++ compiler (Required
                      if CXX environment variable is not set)
+  --atomic-refcount  Count Object references atomically, so that objects
+                     may be shared between threads
 EOT
 	exit;
 }
@@ -155,6 +161,9 @@ else {
 }
 $ENV{'CXX'} = $opt_cxx;		# This will be passed into mkmf
 
+print "Atomic reference counts... ", ($opt_atomic_refcount ? "enabled" : "disabled"), "\n";
+generate_config_header();
+
 print "Generating libtpt Makefiles ";
 generate_toplevel_makefile();
 generate_library_makefile();
@@ -189,6 +198,25 @@ To install, type:
 EOT
 }
 
+sub generate_config_header {
+	unless (open(IN, "<$config_h_in")) {
+		print STDERR "\n$0: can't open $config_h_in: $!\n";
+		exit 1;
+	}
+	unless (open(OUT, ">$config_h")) {
+		print STDERR "\n$0: can't open $config_h: $!\n";
+		exit 1;
+	}
+
+	my $atomic = $opt_atomic_refcount ? 1 : 0;
+	while (<IN>) {
+		s/\@TPT_ATOMIC_REFCOUNT_VALUE\@/$atomic/g;
+		print OUT;
+	}
+	close OUT;
+	close IN;
+}
+
 sub generate_toplevel_makefile {
 	unless (open(SPEC, ">$install_spec")) {
 		print STDERR "\n$0: can't open $install_spec: $!\n";
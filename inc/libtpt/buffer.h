@@ -47,22 +47,53 @@ namespace TPT {
  * The TPT::Buffer class provides a generic way to buffer input from
  * a file, file stream, or existing buffer one character at a time.
  *
+ * A file opened with mode mapped is mapped read-only into memory on POSIX
+ * systems instead of being copied, when it is at least mapthreshold bytes
+ * long.  The mapping is read in place, so the file must not be truncated
+ * or rewritten while the Buffer exists; reading past the end of a file
+ * that has been truncated raises SIGBUS.  Replacing the file by renaming
+ * a new one over it is safe.
+ *
  */
 class Buffer {
 public:
+	/// How an existing buffer is held.
+	enum copymode {
+		copy,	// copy the caller's memory
+		borrow	// use the caller's memory, which must outlive the Buffer
+	};
+
+	/// How much of an input stream is kept.
+	enum streammode {
+		keepall,	// keep everything read, so any offset can be revisited
+		window		// keep only what has not been discarded
+	};
+
+	/// How a file is read.
+	enum filemode {
+		streamed,	// read the file through a stream as it is needed
+		mapped		// map a file of mapthreshold bytes or more
+	};
+
 	/// Instantiate on filename.
-	explicit Buffer(const char* filename);
+	explicit Buffer(const char* filename, filemode mode = streamed);
 	/// Instantiate on open input fstream.
-	explicit Buffer(std::istream* is);
+	explicit Buffer(std::istream* is, streammode mode = keepall);
 	/// Instantiate on existing buffer.
-	explicit Buffer(const char* buffer, unsigned long size);
+	explicit Buffer(const char* buffer, unsigned long size,
+		copymode mode = copy);
 	/// Instantiate on subsection of existing buffer
-	explicit Buffer(const Buffer& buf, unsigned long start, unsigned long end);
+	explicit Buffer(const Buffer& buf, unsigned long start, unsigned long end,
+		copymode mode = copy);
 	/// Cleanup.
 	~Buffer();
 
 	/// Get next character from buffer.
 	char getnextchar();
+	/// Get the characters already buffered after the current offset.
+	const char* peek(unsigned long& count);
+	/// Step over characters returned by peek().
+	void skip(unsigned long count);
 	/// Back up in the buffer.
 	bool unget();
 	/// Reset pointers to beginning of buffer.
@@ -77,6 +108,10 @@ public:
 	char operator[](unsigned long index) const;
 	/// Current size
 	unsigned long size() const;
+	/// Smallest file that mode mapped maps into memory.
+	static const unsigned long mapthreshold = 65536;
+	/// Allow a window stream to drop data before index.
+	void discard(unsigned long index);
 
 	/// Set buffer name
 	void setname(const char* name);
@@ -84,15 +119,25 @@ public:
 	const char* getname();
 
 private:
+	enum storage_type {
+		storage_heap,	// buffer_ allocated with new[]
+		storage_mapped,	// buffer_ is a read-only mapping of the file
+		storage_borrowed	// buffer_ belongs to the caller
+	};
+
 	std::istream* instr_;
 	std::string name_;
+	mutable unsigned long bufferbase_;	// offset of buffer_[0]
 	mutable unsigned long buffersize_;
 	mutable unsigned long bufferallocsize_;
 	mutable char* buffer_;
 	unsigned bufferidx_;
 	bool freestreamwhendone_;
+	storage_type storage_;
+	streammode streammode_;
 	mutable bool done_;
 
+	bool mapfile(const char* filename);
 	void openfile(const char* filename);
 	bool readfile() const;
 	void enlarge() const;	// increase buffer size
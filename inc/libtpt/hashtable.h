@@ -0,0 +1,244 @@
+/*
+ * hashtable.h
+ *
+ * A string keyed open addressing hash table template.
+ *
+ * Copyright (C) 2010 Isaac W. Foraker (isaac at noscience dot net)
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Author nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef include_libtpt_hashtable_h
+#define include_libtpt_hashtable_h
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+namespace TPT {
+
+/**
+ * A hash table keyed on strings, used by hash Objects and the symbols
+ * table.  Entries are kept in one array in the order they were added and
+ * are found through an open addressing index that holds the hash of each
+ * key, so most lookups touch one slot and compare one key.
+ *
+ * The interface is a subset of std::map.  Iteration is not in key order,
+ * erasing an entry moves the last entry into its place, and adding an
+ * entry may move all entries, so do not hold references to values across
+ * an insert.
+ */
+template <typename T>
+class HashTable {
+public:
+	typedef std::string key_type;
+	typedef T mapped_type;
+	typedef std::pair< std::string, T > value_type;
+	typedef value_type* iterator;
+	typedef const value_type* const_iterator;
+	typedef std::size_t size_type;
+
+	HashTable() {}
+
+	iterator begin() { return entries.empty() ? 0 : &entries[0]; }
+	iterator end() { return begin() + entries.size(); }
+	const_iterator begin() const { return entries.empty() ? 0 : &entries[0]; }
+	const_iterator end() const { return begin() + entries.size(); }
+
+	size_type size() const { return entries.size(); }
+	bool empty() const { return entries.empty(); }
+
+	iterator find(const std::string& key)
+	{
+		size_type index = lookup(key, hashkey(key));
+		return index ? begin() + index - 1 : end();
+	}
+	const_iterator find(const std::string& key) const
+	{
+		size_type index = lookup(key, hashkey(key));
+		return index ? begin() + index - 1 : end();
+	}
+	size_type count(const std::string& key) const
+	{
+		return lookup(key, hashkey(key)) ? 1 : 0;
+	}
+
+	T& operator[](const std::string& key)
+	{
+		unsigned hash = hashkey(key);
+		size_type index = lookup(key, hash);
+		if (index)
+			return entries[index - 1].second;
+		return add(value_type(key, T()), hash)->second;
+	}
+
+	std::pair< iterator, bool > insert(const value_type& value)
+	{
+		unsigned hash = hashkey(value.first);
+		size_type index = lookup(value.first, hash);
+		if (index)
+			return std::make_pair(begin() + index - 1, false);
+		return std::make_pair(add(value, hash), true);
+	}
+
+	void erase(iterator pos)
+	{
+		size_type index = pos - begin(), last = entries.size() - 1;
+		removeslot(slotof(index));
+		if (index != last)
+		{
+			// Move the last entry into the hole
+			size_type s = slotof(last);
+			entries[index].first.swap(entries[last].first);
+			entries[index].second = entries[last].second;
+			hashes[index] = hashes[last];
+			slots[s].index = index + 1;
+		}
+		entries.pop_back();
+		hashes.pop_back();
+	}
+	size_type erase(const std::string& key)
+	{
+		iterator it(find(key));
+		if (it == end())
+			return 0;
+		erase(it);
+		return 1;
+	}
+
+	void clear()
+	{
+		entries.clear();
+		hashes.clear();
+		slots.clear();
+	}
+	void swap(HashTable& x)
+	{
+		entries.swap(x.entries);
+		hashes.swap(x.hashes);
+		slots.swap(x.slots);
+	}
+
+private:
+	// An index slot: the key's hash and its entry index + 1, or 0 if empty
+	struct slot {
+		unsigned hash;
+		unsigned index;
+	};
+
+	std::vector< value_type > entries;
+	std::vector< unsigned > hashes;		// hash of each entry's key
+	std::vector< slot > slots;			// size is zero or a power of 2
+
+	// FNV-1a
+	static unsigned hashkey(const std::string& key)
+	{
+		unsigned hash = 2166136261u;
+		std::string::const_iterator it(key.begin()), end(key.end());
+		for (; it != end; ++it)
+		{
+			hash^= static_cast< unsigned char >(*it);
+			hash*= 16777619u;
+		}
+		return hash;
+	}
+
+	// Get the entry index + 1 of key, or 0 if it does not exist
+	size_type lookup(const std::string& key, unsigned hash) const
+	{
+		if (slots.empty())
+			return 0;
+		size_type mask = slots.size() - 1, s = hash & mask;
+		for (; slots[s].index; s = (s + 1) & mask)
+			if (slots[s].hash == hash && entries[slots[s].index - 1].first == key)
+				return slots[s].index;
+		return 0;
+	}
+
+	// Get the slot that holds entry index
+	size_type slotof(size_type index) const
+	{
+		size_type mask = slots.size() - 1, s = hashes[index] & mask;
+		while (slots[s].index != index + 1)
+			s = (s + 1) & mask;
+		return s;
+	}
+
+	// Add an entry for a key that does not exist
+	iterator add(const value_type& value, unsigned hash)
+	{
+		if ((entries.size() + 1) * 2 > slots.size())
+			rehash(slots.empty() ? 8 : slots.size() * 2);
+		entries.push_back(value);
+		hashes.push_back(hash);
+		placeslot(hash, entries.size());
+		return begin() + entries.size() - 1;
+	}
+
+	void placeslot(unsigned hash, size_type index)
+	{
+		size_type mask = slots.size() - 1, s = hash & mask;
+		while (slots[s].index)
+			s = (s + 1) & mask;
+		slots[s].hash = hash;
+		slots[s].index = static_cast< unsigned >(index);
+	}
+
+	void rehash(size_type size)
+	{
+		slot empty = { 0, 0 };
+		slots.assign(size, empty);
+		for (size_type i = 0; i < hashes.size(); ++i)
+			placeslot(hashes[i], i + 1);
+	}
+
+	// Empty slot s, shifting back any later slots that probed past it
+	void removeslot(size_type s)
+	{
+		size_type mask = slots.size() - 1, next = s;
+		for (;;)
+		{
+			next = (next + 1) & mask;
+			if (!slots[next].index)
+				break;
+			size_type home = slots[next].hash & mask;
+			if (next > s ? (home <= s || home > next) :
+				(home <= s && home > next))
+			{
+				slots[s] = slots[next];
+				s = next;
+			}
+		}
+		slots[s].index = 0;
+	}
+};
+
+} // end namespace TPT
+
+#endif // include_libtpt_hashtable_h
@@ -37,6 +37,7 @@
 #include <libtpt/tpttypes.h>
 #include <libtpt/buffer.h>
 #include <libtpt/symbols.h>
+#include <libtpt/template.h>
 #include <iosfwd>
 #include <string>
 #include <vector>
@@ -45,6 +46,7 @@ namespace TPT {
 
 // Forward Declarations
 class Parser_Impl;
+class TemplateCache;
 class Object;
 
 /**
@@ -60,6 +62,7 @@ public:
 	IParser(const char* filename, Symbols& st);
 	IParser(const char* buf, unsigned long size, Symbols& st);
 	IParser(Buffer& buf, Symbols& st);
+	IParser(const Template& t, Symbols& st);
 	~IParser();
 
 	/// Parse template into a string.
@@ -75,6 +78,8 @@ public:
 
 	/// Add an include search path.
 	void addincludepath(const char* path);
+	/// Share compiled include files through a TemplateCache.
+	void setincludecache(TemplateCache& cache);
 	
 	/// Add a callback function.
 	bool addfunction(const char* name,
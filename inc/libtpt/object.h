@@ -34,11 +34,15 @@
 #ifndef include_libtpt_object_impl_h
 #define include_libtpt_object_impl_h
 
+// Found on the include path, so that a build's generated copy is used
+#include <libtpt/tptconfig.h>
 #include "compat.h"
 #include "token.h"
 #include "smartptr.h"
 #include "tptexcept.h"
 #include "tpttypes.h"
+#include "hashtable.h"
+#include <cstddef>
 #include <string>
 #include <map>
 #include <vector>
@@ -63,14 +67,22 @@ public:
 		type_token
 	};
 
+	// kinds of value a scalar object may hold
+	enum scalar_types {
+		scalar_string = 0,
+		scalar_integer,
+		scalar_real
+	};
+
 	// Some typedefs
-	typedef notboost::shared_ptr< Object > PtrType;
+	typedef notboost::intrusive_ptr< Object > PtrType;
 	typedef std::vector< PtrType > ArrayType;
-	typedef std::map< std::string, PtrType > HashType;
+	// Not ordered, and not a std::map before version 1.34
+	typedef HashTable< PtrType > HashType;
 	typedef Token<> TokenType;
 
 	// Basic ctor
-	Object() : type(type_notalloc) {}
+	Object() : refcount(0), type(type_notalloc) {}
 
 	// Construct specified type of object
 	explicit Object(obj_types t) throw(tptexception);
@@ -88,6 +100,10 @@ public:
 	// dtor
 	~Object() { deallocate(); }
 
+	// Objects made while a parser runs are kept in the parser's arena
+	static void* operator new(std::size_t size);
+	static void operator delete(void* p);
+
 	// Deallocate this object
 	void deallocate();
 
@@ -111,6 +127,15 @@ public:
 	void settype(obj_types t) throw(tptexception);
 
 	std::string& scalar() throw(tptexception);
+	// Read the string without changing this object, using buf if needed
+	const std::string& scalar(std::string& buf) const;
+	// Numeric scalars are kept in binary until scalar() is called
+	TIntegerType integer() throw(tptexception);
+	double real() throw(tptexception);
+	void setinteger(TIntegerType n);
+	void setreal(double d);
+	// Valid when gettype() is type_scalar
+	scalar_types getscalartype() const { return scalartype; }
 	ArrayType& array() throw(tptexception);
 	HashType& hash() throw(tptexception);
 	TokenType& token() throw(tptexception);
@@ -120,18 +145,59 @@ public:
     Object& operator[](const char* k) throw(tptexception);
 
 private:
+	friend void intrusive_ptr_add_ref(const Object* obj);
+	friend void intrusive_ptr_release(const Object* obj);
+	static void atomicaddref(const Object* obj);
+	static long atomicrelease(const Object* obj);
+
 	void create(obj_types t) throw(tptexception);
 	void createcopy(const Object& obj) throw(tptexception);
-
+	void makestring();
+	void numbertostring(std::string& out) const;
+	// The string of a string scalar, kept in the object itself
+	std::string& str()
+	{ return *static_cast< std::string* >(static_cast< void* >(u.str)); }
+	const std::string& str() const
+	{ return *static_cast< const std::string* >(
+		static_cast< const void* >(u.str)); }
+
+	mutable long refcount;	// number of PtrTypes to this object
 	obj_types type;
+	scalar_types scalartype;
 	union object_union {
-		std::string* str;
+		char str[sizeof(std::string)];	// short text stays in the object
 		ArrayType* array;
 		HashType* hash;
 		TokenType* token;
+		TIntegerType integer;
+		double real;
 	} u;
 };
 
+/*
+ * Count the PtrTypes to an Object.  When LIBTPT_ATOMIC_REFCOUNT is set in
+ * tptconfig.h the count is changed atomically, so that objects may be shared between
+ * threads.
+ */
+inline void intrusive_ptr_add_ref(const Object* obj)
+{
+#if LIBTPT_ATOMIC_REFCOUNT
+	Object::atomicaddref(obj);
+#else
+	++obj->refcount;
+#endif
+}
+
+inline void intrusive_ptr_release(const Object* obj)
+{
+#if LIBTPT_ATOMIC_REFCOUNT
+	if (!Object::atomicrelease(obj))
+#else
+	if (!--obj->refcount)
+#endif
+		delete obj;
+}
+
 
 } // end namespace TPT
 
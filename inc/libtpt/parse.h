@@ -37,6 +37,7 @@
 #include <libtpt/tpttypes.h>
 #include <libtpt/buffer.h>
 #include <libtpt/symbols.h>
+#include <libtpt/template.h>
 #include <iosfwd>
 #include <string>
 #include <vector>
@@ -45,6 +46,7 @@ namespace TPT {
 
 // Forward Declarations
 class Parser_Impl;
+class TemplateCache;
 class Object;
 
 /**
@@ -62,6 +64,8 @@ public:
 	Parser(const char* buf, unsigned long size, const Symbols& st);
 	Parser(Buffer& buf);
 	Parser(Buffer& buf, const Symbols& st);
+	Parser(const Template& t);
+	Parser(const Template& t, const Symbols& st);
 	~Parser();
 
 	/// Parse template into a string.
@@ -77,6 +81,8 @@ public:
 
 	/// Add an include search path.
 	void addincludepath(const char* path);
+	/// Share compiled include files through a TemplateCache.
+	void setincludecache(TemplateCache& cache);
 	
 	/// Add a callback function.
 	bool addfunction(const char* name,
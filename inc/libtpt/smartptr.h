@@ -108,6 +108,65 @@ public:
     }
 };
 
+/*
+ * A pointer to an object that keeps its own reference count, so no
+ * separate count is allocated.  The count is kept by the functions
+ * intrusive_ptr_add_ref(T*) and intrusive_ptr_release(T*), found by
+ * argument dependent lookup, and release deletes the object when the
+ * last reference goes away.
+ */
+template <typename T>
+class intrusive_ptr {
+private:
+	T* ptr;
+public:
+
+	typedef intrusive_ptr<T>* pointer;
+	typedef const intrusive_ptr<T>* const_pointer;
+	typedef intrusive_ptr<T>& reference;
+	typedef const intrusive_ptr<T>& const_reference;
+
+	intrusive_ptr<T>() : ptr(0) { }
+	intrusive_ptr<T>(const intrusive_ptr<T>& ip) : ptr(ip.ptr)
+	{ if (ptr) intrusive_ptr_add_ref(ptr); }
+	intrusive_ptr<T>(const T* p) : ptr(const_cast<T*>(p))
+	{ if (ptr) intrusive_ptr_add_ref(ptr); }
+	~intrusive_ptr<T>()
+	{
+		if (ptr) intrusive_ptr_release(ptr);
+	}
+	T* get() const {
+		return ptr;
+	}
+	intrusive_ptr<T>& operator=(const intrusive_ptr<T>& ip)
+	{
+		return *this = ip.ptr;
+	}
+	intrusive_ptr<T>& operator=(T* p)
+	{
+		// Count the new object first in case it is the same one
+		if (p) intrusive_ptr_add_ref(p);
+		T* old = ptr;
+		ptr = p;
+		if (old) intrusive_ptr_release(old);
+		return *this;
+	}
+	void swap(intrusive_ptr<T>& ip)
+	{
+		T* p = ptr;
+		ptr = ip.ptr;
+		ip.ptr = p;
+	}
+	T& operator*() const
+	{
+		return *ptr;
+	}
+	T* operator->() const
+	{
+		return ptr;
+	}
+};
+
 } // end namespace notboost
 
 #endif // include_notboost_smartptr_h
@@ -67,6 +67,7 @@ public:
 	~Symbols();
 
 	void copy(const Symbols& s);
+	void freeze();
 
 	bool set(const SymbolKeyType& id, const SymbolValueType& value);
 	bool set(const SymbolKeyType& id, int value);
@@ -0,0 +1,98 @@
+/*
+ * tcache.h
+ *
+ * A cache of compiled templates, keyed by file name.
+ *
+ * Copyright (C) 2010 Isaac W. Foraker (isaac at noscience dot net)
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Author nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef include_tpt_tcache_h
+#define include_tpt_tcache_h
+
+#include <libtpt/template.h>
+
+namespace TPT {
+
+// Forward Declarations
+class TemplateCache_Impl;
+
+/**
+ * The TemplateCache class holds compiled Templates loaded from files so
+ * that hot templates are read and compiled only once.  Entries are keyed
+ * by the canonical path of the file, and each lookup checks the file's
+ * modification time and size with stat() so an edited file is compiled
+ * again.  When the cache is full the least recently used entry is
+ * dropped.
+ *
+ * A TemplateCache may be shared by several threads.  A process wide
+ * instance is available through TemplateCache::global().
+ *
+ * @author	Isaac W. Foraker
+ * @exception	tptexception
+ */
+class TemplateCache {
+public:
+	explicit TemplateCache(unsigned long maxsize = 64);
+	~TemplateCache();
+
+	/// Get the compiled Template for a file, compiling it if needed.
+	Template get(const char* filename);
+	/// Drop a file from the cache.
+	bool remove(const char* filename);
+	/// Drop every entry from the cache.
+	void clear();
+
+	/// Set the maximum number of entries; 0 disables caching.
+	void setmaxsize(unsigned long maxsize);
+	/// Get the maximum number of entries.
+	unsigned long getmaxsize() const;
+	/// Get the number of entries currently cached.
+	unsigned long size() const;
+
+	/// Get the number of lookups answered from the cache.
+	unsigned long gethits() const;
+	/// Get the number of lookups that had to compile the file.
+	unsigned long getmisses() const;
+	/// Reset the hit and miss counters.
+	void resetstats();
+
+	/// Get the process wide TemplateCache.
+	static TemplateCache& global();
+
+private:
+	TemplateCache_Impl* imp;
+
+	TemplateCache(const TemplateCache&);
+	TemplateCache& operator=(const TemplateCache&);
+};
+
+} // end namespace TPT
+
+#endif // include_tpt_tcache_h
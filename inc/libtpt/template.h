@@ -0,0 +1,98 @@
+/*
+ * template.h
+ *
+ * A template compiled once from a Buffer, ready to be rendered many times.
+ *
+ * Copyright (C) 2010 Isaac W. Foraker (isaac at noscience dot net)
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Author nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef include_tpt_template_h
+#define include_tpt_template_h
+
+#include <libtpt/tpttypes.h>
+#include <libtpt/buffer.h>
+
+namespace TPT {
+
+// Forward Declarations
+class Template_Impl;
+
+/**
+ * The Template class holds a template that has been lexed and compiled
+ * into a tree of nodes.  A Template is built once and may then be
+ * rendered any number of times, against different Symbols tables, by
+ * passing it to a Parser or IParser.  Rendering a Template never lexes
+ * the template source again.
+ *
+ * Templates are reference counted handles, so copying a Template is
+ * cheap and copies share the same compiled tree.
+ *
+ * While compiling, expressions made only of literals and the built-in
+ * functions length, uc, lc, concat, eval and repeat are replaced by their
+ * value, and @if branches and @while loops with a constant condition are
+ * removed.  A Parser that replaces one of those built-in functions with
+ * addfunction() will not see it called where it was folded.
+ *
+ * @author	Isaac W. Foraker
+ * @exception	tptexception
+ */
+class Template {
+public:
+	Template();
+	explicit Template(const char* filename);
+	Template(const char* buf, unsigned long size);
+	explicit Template(Buffer& buf);
+	Template(const Template& t);
+	~Template();
+
+	Template& operator=(const Template& t);
+
+	/// True when no template has been compiled.
+	bool empty() const;
+	/// Get the count of errors found while compiling.
+	unsigned geterrorcount() const;
+	/// Get the list of errors found while compiling.
+	bool geterrorlist(ErrorList& errlist) const;
+	/// Get the number of expressions replaced by their constant value.
+	unsigned getfoldcount() const;
+	/// Get the number of branches removed because of a constant condition.
+	unsigned getprunecount() const;
+
+private:
+	Template_Impl* imp;
+
+	explicit Template(Template_Impl* ti);
+	friend class Parser_Impl;
+	friend class Compiler;
+};
+
+} // end namespace TPT
+
+#endif // include_tpt_template_h
@@ -90,23 +90,46 @@ enum TokenTypes {
 	token_ishash		// @ishash
 };
 
+// Operator and relop tokens are classified by the lexer so that the
+// expression parsers do not need to compare token values.
+enum OperatorKinds {
+	oper_none = 0,		// not an operator, or a lone =
+	oper_and,			// &&
+	oper_or,			// ||
+	oper_xor,			// ^^
+	oper_eq,			// ==
+	oper_ne,			// !=
+	oper_lt,			// <
+	oper_gt,			// >
+	oper_le,			// <=
+	oper_ge,			// >=
+	oper_add,			// +
+	oper_sub,			// -
+	oper_mul,			// *
+	oper_div,			// /
+	oper_mod,			// %
+	oper_not			// !
+};
+
 template<typename E=TokenTypes> struct Token {
 	typedef E en;
 	E type;
+	OperatorKinds op;
 	std::string value;
 	unsigned column;
 	unsigned lineno;
 
-	Token<E>() {}
-	Token<E>(const Token<E>& t) : type(t.type),value(t.value),
+	Token<E>() : op(oper_none) {}
+	Token<E>(const Token<E>& t) : type(t.type), op(t.op), value(t.value),
 		column(t.column), lineno(t.lineno) {}
 	Token<E>(const std::string& newval, unsigned newcol, unsigned newlineno) :
-		value(newval), column(newcol), lineno(newlineno) {}
+		op(oper_none), value(newval), column(newcol), lineno(newlineno) {}
 	Token<E>(unsigned newcol, unsigned newlineno) :
-		column(newcol), lineno(newlineno) {}
+		op(oper_none), column(newcol), lineno(newlineno) {}
 	Token<E>& operator=(const Token<E>& t)
 	{
 		type=t.type;
+		op=t.op;
 		value=t.value;
 		column=t.column;
 		lineno=t.lineno;
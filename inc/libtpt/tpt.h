@@ -37,6 +37,8 @@
 #include "compat.h"
 #include "buffer.h"
 #include "symbols.h"
+#include "template.h"
+#include "tcache.h"
 #include "parse.h"
 #include "iparse.h"
 #include "object.h"
@@ -0,0 +1,52 @@
+/*
+ * tptconfig.h
+ *
+ * Build settings that the library and the programs using it must agree on.
+ * configure.pl and CMake write this file from src/lib/tptconfig.h.in; the copy
+ * in the source tree holds the defaults, for builds that use neither.
+ *
+ * Copyright (C) 2010 Isaac W. Foraker (isaac at noscience dot net)
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Author nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef include_libtpt_tptconfig_h
+#define include_libtpt_tptconfig_h
+
+#ifdef LIBTPT_ATOMIC_REFCOUNT
+#error "LIBTPT_ATOMIC_REFCOUNT is set in libtpt/tptconfig.h, not on the command line"
+#endif
+
+/*
+ * Set to 1 to count Object references atomically, so that objects may be
+ * shared between threads.  Shared objects must only be read, and scalars
+ * read with Object::scalar(std::string&).
+ */
+#define LIBTPT_ATOMIC_REFCOUNT 0
+
+#endif // include_libtpt_tptconfig_h
@@ -37,6 +37,9 @@
 #include <string>
 #include <vector>
 #include <map>
+#ifndef _MSC_VER
+#	include <sys/types.h>
+#endif
 
 namespace TPT {
 /**
@@ -53,6 +56,15 @@ typedef std::string TScalarType;
 typedef std::vector< std::string > TArrayType;
 typedef std::map< std::string, std::string > THashType;
 
+/**
+ * Integer type used for template arithmetic.
+ */
+#ifdef _MSC_VER
+typedef __int64 TIntegerType;
+#else
+typedef int64_t TIntegerType;
+#endif
+
 }
 
 #endif // include_tpt_tpttypes_h
@@ -133,7 +133,7 @@ void dumptemplate(clo::parser& parser)
     // Construct the parser based on the input source
     if (options.console)
     {
-        buf = new TPT::Buffer(&std::cin);
+        buf = new TPT::Buffer(&std::cin, TPT::Buffer::window);
         p = new TPT::Parser(*buf, sym);
     }
     else
@@ -148,12 +148,15 @@ void dumptemplate(clo::parser& parser)
 			p->addincludepath(it->c_str());
 	}
 
-	std::stringstream str;
-
-	p->run(str);
-	if (!options.check)
+	// Write straight to stdout so long input is not held in memory.
+	if (options.check)
+	{
+		std::stringstream str;
+		p->run(str);
+	}
+	else
 	{
-		std::cout << str.str();
+		p->run(std::cout);
 		std::cout.flush();
 	}
 	
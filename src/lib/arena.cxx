@@ -0,0 +1,269 @@
+/*
+ * arena.cxx
+ *
+ * Pool of Object blocks used while a parser runs
+ *
+ * Copyright (C) 2010 Isaac W. Foraker (isaac at noscience dot net)
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Author nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "conf.h"
+#include "arena.h"
+#include "threads.h"
+#include <libtpt/object.h>
+#include <new>
+
+namespace TPT {
+
+namespace {
+
+// Blocks in the first chunk of an arena, doubling up to the largest
+const std::size_t firstchunkblocks = 32;
+const std::size_t maxchunkblocks = 1024;
+
+// The arena in use by the parser running on this thread
+TPT_THREADLOCAL ObjectArena* currentarena = 0;
+
+// Set while Objects on this thread must come from the heap
+TPT_THREADLOCAL bool heaponly = false;
+
+// Chunks held by the arenas of all threads
+volatile long chunkcount = 0;
+
+/*
+ * Objects may be released by another thread only when their reference
+ * counts are atomic, so the arena's count follows the same setting.
+ */
+inline long increment(long& v)
+{
+#if LIBTPT_ATOMIC_REFCOUNT
+	return atomicincrement(v);
+#else
+	return ++v;
+#endif
+}
+
+inline long decrement(long& v)
+{
+#if LIBTPT_ATOMIC_REFCOUNT
+	return atomicdecrement(v);
+#else
+	return --v;
+#endif
+}
+
+} // end anonymous namespace
+
+
+ObjectArena::ObjectArena() :
+	freelist(0), next(0), end(0),
+	blocksize(sizeof(header) +
+		(sizeof(Object) + sizeof(header) - 1) / sizeof(header) * sizeof(header)),
+	chunkblocks(firstchunkblocks), live(1)
+{
+}
+
+
+ObjectArena::~ObjectArena()
+{
+	std::vector< char* >::iterator it(chunks.begin()), cend(chunks.end());
+	for (; it != cend; ++it)
+	{
+		delete[] *it;
+		atomicdecrement(chunkcount);
+	}
+}
+
+
+/*
+ * Allocate memory for an Object.  While a parser runs on this thread it
+ * comes from the parser's arena, unless a heapscope is open, and
+ * otherwise from the heap.
+ */
+void* ObjectArena::allocate(std::size_t size)
+{
+	ObjectArena* arena = currentarena;
+	header* block;
+	if (arena && !heaponly && size == sizeof(Object))
+	{
+		block = arena->carve();
+		block->arena = arena;
+	}
+	else
+	{
+		block = static_cast< header* >(::operator new(sizeof(header) + size));
+		block->arena = 0;
+	}
+	return block + 1;
+}
+
+
+/*
+ * Free memory from allocate().  Blocks freed by the thread running the
+ * arena's parser are kept for reuse.
+ */
+void ObjectArena::deallocate(void* p)
+{
+	if (!p)
+		return;
+	header* block = static_cast< header* >(p) - 1;
+	ObjectArena* arena = block->arena;
+	if (!arena)
+		::operator delete(block);
+	else if (arena == currentarena)
+	{
+		block->arena = reinterpret_cast< ObjectArena* >(arena->freelist);
+		arena->freelist = block;
+		decrement(arena->live);
+	}
+	else
+		arena->release();
+}
+
+
+/*
+ * Take a block from the free list, or the next block of the newest chunk.
+ */
+ObjectArena::header* ObjectArena::carve()
+{
+	increment(live);
+	if (freelist)
+	{
+		header* block = freelist;
+		freelist = reinterpret_cast< header* >(block->arena);
+		return block;
+	}
+	if (next == end)
+	{
+		chunks.reserve(chunks.size() + 1);
+		char* chunk = new char[chunkblocks * blocksize];
+		chunks.push_back(chunk);
+		atomicincrement(chunkcount);
+		next = chunk;
+		end = chunk + chunkblocks * blocksize;
+		if (chunkblocks < maxchunkblocks)
+			chunkblocks *= 2;
+	}
+	header* block = reinterpret_cast< header* >(next);
+	next += blocksize;
+	return block;
+}
+
+
+/*
+ * Drop one block or the arena's own hold on it, and free the arena when
+ * nothing is left.
+ */
+void ObjectArena::release()
+{
+	if (!decrement(live))
+		delete this;
+}
+
+
+/*
+ * Replace the Objects held by obj that were carved from an arena with
+ * copies on the heap.  Objects on the heap hold only Objects on the heap,
+ * so only the copies need to be searched in turn.
+ */
+void ObjectArena::keep(Object& obj)
+{
+	heapscope heap;
+	if (obj.gettype() == Object::type_array)
+	{
+		Object::ArrayType& array = obj.array();
+		Object::ArrayType::iterator it(array.begin()), end(array.end());
+		for (; it != end; ++it)
+			if (fromarena(it->get()))
+			{
+				*it = new Object(**it);
+				keep(**it);
+			}
+	}
+	else if (obj.gettype() == Object::type_hash)
+	{
+		Object::HashType& hash = obj.hash();
+		Object::HashType::iterator it(hash.begin()), end(hash.end());
+		for (; it != end; ++it)
+			if (fromarena(it->second.get()))
+			{
+				it->second = new Object(*it->second);
+				keep(*it->second);
+			}
+	}
+}
+
+
+/*
+ * Check whether obj was carved from an arena.
+ */
+bool ObjectArena::fromarena(const Object* obj)
+{
+	return obj && (static_cast< const header* >(
+		static_cast< const void* >(obj)) - 1)->arena;
+}
+
+
+long ObjectArena::getchunkcount()
+{
+	return chunkcount;
+}
+
+
+ObjectArena::scope::scope() : arena(0)
+{
+#ifndef LIBTPT_NO_OBJECT_ARENA
+	if (!currentarena)
+		currentarena = arena = new ObjectArena;
+#endif
+}
+
+
+ObjectArena::scope::~scope()
+{
+	if (arena)
+	{
+		currentarena = 0;
+		arena->release();
+	}
+}
+
+
+ObjectArena::heapscope::heapscope() : saved(heaponly)
+{
+	heaponly = true;
+}
+
+
+ObjectArena::heapscope::~heapscope()
+{
+	heaponly = saved;
+}
+
+} // end namespace TPT
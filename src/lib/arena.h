@@ -0,0 +1,128 @@
+/*
+ * arena.h
+ *
+ * Pool of Object blocks used while a parser runs
+ *
+ * Copyright (C) 2010 Isaac W. Foraker (isaac at noscience dot net)
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Author nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef include_libtpt_arena_h
+#define include_libtpt_arena_h
+
+#include <cstddef>
+#include <vector>
+
+namespace TPT {
+
+class Object;
+
+/*
+ * Objects made while a parser runs are carved from large chunks owned by
+ * an ObjectArena instead of being allocated one at a time, and blocks
+ * freed on the thread running the parser are reused.  The chunks are
+ * released together once the run has ended and the last Object carved
+ * from them is gone.
+ *
+ * One Object that outlives the run would keep all of the run's chunks, so
+ * Objects stored into a symbols table, which may outlive the run, are
+ * made on the heap inside a heapscope, and keep() moves to the heap any
+ * Objects from the arena that a stored value shares.  An Object on the
+ * heap therefore never holds one from an arena.
+ */
+class ObjectArena {
+public:
+	static void* allocate(std::size_t size);
+	static void deallocate(void* p);
+
+	// Give an Object to be stored in a symbols table heap copies of any
+	// Objects under it that came from an arena
+	static void keep(Object& obj);
+
+	// Number of chunks held by all arenas, for the tests
+	static long getchunkcount();
+
+	/*
+	 * Make a new arena current on this thread for the life of the scope,
+	 * unless one already is.
+	 */
+	class scope {
+	public:
+		scope();
+		~scope();
+	private:
+		ObjectArena* arena;
+
+		scope(const scope&);
+		scope& operator=(const scope&);
+	};
+
+	/*
+	 * Allocate Objects on this thread from the heap for the life of the
+	 * scope.
+	 */
+	class heapscope {
+	public:
+		heapscope();
+		~heapscope();
+	private:
+		bool saved;
+
+		heapscope(const heapscope&);
+		heapscope& operator=(const heapscope&);
+	};
+
+private:
+	// Each block starts with the arena it came from, or 0 for the heap
+	union header {
+		ObjectArena* arena;
+		double align;
+	};
+
+	std::vector< char* > chunks;
+	header* freelist;	// freed blocks, linked through their headers
+	char* next;			// next unused block in the newest chunk
+	char* end;			// end of the newest chunk
+	std::size_t blocksize;
+	std::size_t chunkblocks;	// blocks in the next chunk
+	long live;			// blocks in use, plus one while current
+
+	ObjectArena();
+	~ObjectArena();
+	header* carve();
+	void release();
+	static bool fromarena(const Object* obj);
+
+	ObjectArena(const ObjectArena&);
+	ObjectArena& operator=(const ObjectArena&);
+};
+
+} // end namespace TPT
+
+#endif // include_libtpt_arena_h
@@ -42,6 +42,13 @@
 #include <fstream>
 #include <cstring>
 
+#ifndef _WIN32
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <fcntl.h>
+#	define TPT_USE_MMAP
+#endif
+
 // Anonymous namespace for local constants
 namespace {
     const unsigned BUFFER_SIZE = 4096;
@@ -50,21 +57,33 @@ namespace {
 namespace TPT {
 
 /**
- * Construct a read Buffer for the specified file.
+ * Construct a read Buffer for the specified file.  With mode mapped, a
+ * file of at least mapthreshold bytes is mapped into memory when
+ * possible; see buffer.h for when that is safe.
  *
  * @param   filename        name of file to buffer
+ * @param   mode            streamed or mapped
  * @return  nothing
  */
-Buffer::Buffer(const char* filename) :
+Buffer::Buffer(const char* filename, filemode mode) :
     instr_(0),
     name_(filename),
+    bufferbase_(0),
     buffersize_(0),
-    bufferallocsize_(BUFFER_SIZE),
-    buffer_(new char[BUFFER_SIZE]),
+    bufferallocsize_(0),
+    buffer_(0),
     bufferidx_(0),
     freestreamwhendone_(true),
+    storage_(storage_heap),
+    streammode_(keepall),
     done_(false)
 {
+    // Map the whole file when asked and possible, otherwise read it in
+    // blocks.
+    if (mode == mapped && !mapfile(filename))
+        return;
+    bufferallocsize_ = BUFFER_SIZE;
+    buffer_ = new char[BUFFER_SIZE];
     // Just in case there is an exception while allocating the stream.
     try {
         openfile(filename);
@@ -78,19 +97,25 @@ Buffer::Buffer(const char* filename) :
 
 /**
  * Construct a read Buffer for an open fstream.  The input stream will
- * not be closed when Buffer is destructed.
+ * not be closed when Buffer is destructed.  In window mode, only the
+ * data after the last discard() is kept, so memory use does not grow
+ * with the length of the stream.
  *
  * @param   is          input fstream
+ * @param   mode        keepall or window
  * @return  nothing
  */
-Buffer::Buffer(std::istream* is) :
+Buffer::Buffer(std::istream* is, streammode mode) :
     instr_(is),
     name_("<stream>"),
+    bufferbase_(0),
     buffersize_(0),
     bufferallocsize_(BUFFER_SIZE),
     buffer_(new char[BUFFER_SIZE]),
     bufferidx_(0),
     freestreamwhendone_(false),
+    storage_(storage_heap),
+    streammode_(mode),
     done_(false)
 {
     readfile();
@@ -98,40 +123,70 @@ Buffer::Buffer(std::istream* is) :
 
 
 /**
- * Construct a read Buffer for an existing buffer.
+ * Construct a read Buffer for an existing buffer.  With mode borrow the
+ * memory is neither copied nor freed, and must remain valid and
+ * unchanged for the life of the Buffer.
  *
+ * @param   buf         pointer to the data
+ * @param   bufsize     size of the data
+ * @param   mode        copy or borrow the data
  * @return  nothing
  */
-Buffer::Buffer(const char* buf, unsigned long bufsize) :
+Buffer::Buffer(const char* buf, unsigned long bufsize, copymode mode) :
     instr_(0),
     name_("<memory>"),
+    bufferbase_(0),
     buffersize_(bufsize),
     bufferallocsize_(bufsize),
-    buffer_(new char[bufsize]),
+    buffer_(0),
     bufferidx_(0),
     freestreamwhendone_(false),
+    storage_(mode == borrow ? storage_borrowed : storage_heap),
+    streammode_(keepall),
     done_(!bufsize) // if zero buffer, then done
 {
-    std::memcpy(buffer_, buf, bufsize);
+    if (mode == borrow)
+        buffer_ = const_cast<char*>(buf);
+    else
+    {
+        buffer_ = new char[bufsize];
+        std::memcpy(buffer_, buf, bufsize);
+    }
 }
 
 
 /**
- * Construct a read Buffer on a subspace of an existing Buffer.
+ * Construct a read Buffer on a subspace of an existing Buffer.  With
+ * mode borrow the new Buffer shares the memory of buf, so buf must not
+ * be destroyed or read any further while the new Buffer is in use.
  *
+ * @param   buf         source Buffer
+ * @param   start       offset of the first character
+ * @param   end         offset one past the last character
+ * @param   mode        copy or borrow the data
  * @return  nothing
  */
-Buffer::Buffer(const Buffer& buf, unsigned long start, unsigned long end) :
+Buffer::Buffer(const Buffer& buf, unsigned long start, unsigned long end,
+    copymode mode) :
     instr_(0),
     name_("<buffer>"),
+    bufferbase_(0),
     buffersize_(end-start),
     bufferallocsize_(end-start),
-    buffer_(new char[end-start]),
+    buffer_(0),
     bufferidx_(0),
     freestreamwhendone_(false),
+    storage_(mode == borrow ? storage_borrowed : storage_heap),
+    streammode_(keepall),
     done_(!(end-start))
 {
-    std::memcpy(buffer_, &buf.buffer_[start], end-start);
+    if (mode == borrow)
+        buffer_ = &buf.buffer_[start - buf.bufferbase_];
+    else
+    {
+        buffer_ = new char[end-start];
+        std::memcpy(buffer_, &buf.buffer_[start - buf.bufferbase_], end-start);
+    }
 }
 
 
@@ -140,7 +195,13 @@ Buffer::Buffer(const Buffer& buf, unsigned long start, unsigned long end) :
  */
 Buffer::~Buffer()
 {
-    delete [] buffer_;
+#ifdef TPT_USE_MMAP
+    if (storage_ == storage_mapped)
+        munmap(buffer_, bufferallocsize_);
+    else
+#endif
+    if (storage_ == storage_heap)
+        delete [] buffer_;
     if (freestreamwhendone_)
         delete instr_;
 }
@@ -156,7 +217,7 @@ Buffer::~Buffer()
  */
 char Buffer::getnextchar()
 {
-    register char c = buffer_[bufferidx_];
+    register char c = buffer_[bufferidx_ - bufferbase_];
     ++bufferidx_;
 
     // If our buffer is empty, try reading from the stream
@@ -168,6 +229,39 @@ char Buffer::getnextchar()
 }
 
 
+/**
+ * Get the run of characters that is already buffered after the current
+ * offset, reading the file or stream if nothing is buffered, so that a
+ * caller can scan them in bulk.  The pointer is valid until the Buffer
+ * is next read or modified.
+ *
+ * @param   count           Set to the number of characters available.
+ * @return  pointer to the next character.
+ */
+const char* Buffer::peek(unsigned long& count)
+{
+    if (!done_ && (bufferidx_ >= buffersize_))
+        readfile();
+    count = done_ ? 0 : buffersize_ - bufferidx_;
+    return &buffer_[bufferidx_ - bufferbase_];
+}
+
+
+/**
+ * Step over characters, as if getnextchar() had been called count
+ * times.  count must not be more than peek() returned.
+ *
+ * @param   count           Number of characters to step over.
+ * @return  nothing
+ */
+void Buffer::skip(unsigned long count)
+{
+    bufferidx_+= count;
+    if (bufferidx_ >= buffersize_)
+        readfile();
+}
+
+
 /**
  * Unget a single character back into the buffer.
  *
@@ -176,7 +270,7 @@ char Buffer::getnextchar()
  */
 bool Buffer::unget()
 {
-    if (!bufferidx_)
+    if (bufferidx_ <= bufferbase_)
         return true;
 
     --bufferidx_;
@@ -186,13 +280,14 @@ bool Buffer::unget()
 
 
 /**
- * Reset the buffer index to the beginning of the input buffer.
+ * Reset the buffer index to the beginning of the input buffer, or to
+ * the oldest data still held by a window stream.
  *
  * @return  nothing
  */
 void Buffer::reset()
 {
-    bufferidx_ = 0;
+    bufferidx_ = bufferbase_;
     done_ = false;
 }
 
@@ -200,8 +295,8 @@ void Buffer::reset()
 /**
  * Seek to a index point in the buffer.  The seek will force reading of
  * the file or stream if the index has not yet been buffered.  If the
- * index is past the end of the buffer, the attempt will fail and the
- * internal index will not be reset.
+ * index is past the end of the buffer, or has been discarded, the attempt
+ * will fail and the internal index will not be reset.
  *
  * @param   index           Offset into buffer from beginning.
  * @return  false on success;
@@ -212,7 +307,7 @@ bool Buffer::seek(unsigned long index)
     // This loop allows seeking to part of buffer that has not yet been read.
     while (!done_ && (index >= buffersize_))
         readfile();
-    if (index >= buffersize_)
+    if ((index >= buffersize_) || (index < bufferbase_))
         return true;
     bufferidx_ = index;
     done_ = false;
@@ -245,9 +340,9 @@ char Buffer::operator[](unsigned long index) const
 {
     while (!done_ && (index >= buffersize_))
         readfile();
-    if (index >= buffersize_)
+    if ((index >= buffersize_) || (index < bufferbase_))
         throw tptexception("Index out of bounds");
-    return buffer_[index];
+    return buffer_[index - bufferbase_];
 }
 
 
@@ -284,6 +379,28 @@ unsigned long Buffer::size() const
 }
 
 
+/**
+ * Tell a window stream Buffer that no offset before index will be read
+ * or sought again, so the data may be dropped.  Offsets are not changed
+ * by discarding.  Other Buffers ignore this call.
+ *
+ * @param   index           Offset of the oldest data still needed.
+ * @return  nothing
+ */
+void Buffer::discard(unsigned long index)
+{
+    if ((streammode_ != window) || (index > bufferidx_))
+        return;
+    // Only move the data once enough has been dropped to pay for it.
+    unsigned long dropped = index - bufferbase_;
+    unsigned long kept = buffersize_ - index;
+    if ((dropped < BUFFER_SIZE) || (dropped < kept))
+        return;
+    std::memmove(buffer_, &buffer_[dropped], kept);
+    bufferbase_ = index;
+}
+
+
 /**
  * Set the buffer name.  By default, file buffers will have a name of the
  * filename if the buffer is a file buffer, or 'stream', 'memory', or 'buffer'
@@ -307,6 +424,43 @@ const char* Buffer::getname()
     return name_.c_str();
 }
 
+/*
+ * Map the whole of a regular file into memory, read-only.  Files smaller
+ * than mapthreshold, which gain little from mapping, and files that
+ * cannot be mapped are left to openfile().  The file must not be
+ * truncated while the Buffer exists.
+ *
+ * @param   filename
+ * @return  false on success
+ * @return  true on failure
+ */
+bool Buffer::mapfile(const char* filename)
+{
+#ifdef TPT_USE_MMAP
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return true;
+    struct stat st;
+    void* addr = MAP_FAILED;
+    if (!fstat(fd, &st) && S_ISREG(st.st_mode) &&
+        static_cast<unsigned long>(st.st_size) >= mapthreshold)
+        addr = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+        return true;
+#   ifdef MADV_SEQUENTIAL
+    madvise(addr, st.st_size, MADV_SEQUENTIAL);
+#   endif
+    buffer_ = static_cast<char*>(addr);
+    buffersize_ = bufferallocsize_ = st.st_size;
+    storage_ = storage_mapped;
+    return false;
+#else
+    return true;
+#endif
+}
+
+
 /*
  * Open a file stream for the specified file.
  *
@@ -342,9 +496,9 @@ bool Buffer::readfile() const
         if (!size)
             done_ = true;
         else {
-            if ((buffersize_ + size) >= bufferallocsize_)
+            if ((buffersize_ - bufferbase_ + size) >= bufferallocsize_)
                 enlarge();
-            std::memcpy(&buffer_[buffersize_], buf, size);
+            std::memcpy(&buffer_[buffersize_ - bufferbase_], buf, size);
             buffersize_+= size;
         }
     }
@@ -363,7 +517,7 @@ void Buffer::enlarge() const
     bufferallocsize_+= BUFFER_SIZE;
     // Create a new buffer and swap it for the old buffer
     char* temp = new char[bufferallocsize_];
-    std::memcpy(temp, buffer_, buffersize_);
+    std::memcpy(temp, buffer_, buffersize_ - bufferbase_);
     delete [] buffer_;
     buffer_ = temp;
 }
@@ -0,0 +1,647 @@
+/*
+ * compile.cxx
+ *
+ * Compile a template into a tree of nodes
+ *
+ * Copyright (C) 2010 Isaac W. Foraker (isaac at noscience dot net)
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Author nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "conf.h"
+#include "compile.h"
+#include "parse_impl.h"
+#include <cstdio>
+
+namespace TPT {
+
+const char* toktypestr(const Token<>& tok);
+
+
+/*
+ * Compile a complete template.
+ *
+ */
+Template_Impl* compiletemplate(Buffer& buf)
+{
+	Template_Impl* ti = new Template_Impl;
+	NodeList nodes;
+	Compiler c(buf, ti->errlist);
+	c.compile_main(nodes);
+	c.foldnodes(nodes);
+	ti->foldedexprs = c.foldedexprs;
+	ti->droppedbranches = c.droppedbranches;
+	lowertemplate(nodes, ti->prog);
+	deletenodes(nodes);
+	return ti;
+}
+
+
+/*
+ * Compile the brace enclosed body of a macro.
+ *
+ */
+Template_Impl* compilemacro(const std::string& body, unsigned lineno)
+{
+	Template_Impl* ti = new Template_Impl;
+	Buffer buf(body.c_str(), body.size()+1, Buffer::borrow);
+	NodeList nodes;
+	Compiler c(buf, ti->errlist);
+	c.lex.setlineno(lineno);
+	c.compile_block(nodes);
+	c.foldnodes(nodes);
+	ti->foldedexprs = c.foldedexprs;
+	ti->droppedbranches = c.droppedbranches;
+	lowertemplate(nodes, ti->prog);
+	deletenodes(nodes);
+	return ti;
+}
+
+
+void Compiler::recorderror(const std::string& desc, const Token<>* neartoken)
+{
+	char buf[32];
+	if (neartoken)
+		std::sprintf(buf, "%u", neartoken->lineno);
+	else
+		std::sprintf(buf, "%u", lex.getlineno());
+	std::string errstr(desc);
+	errstr+= " at line ";
+	errstr+= buf;
+	if (neartoken)
+	{
+		errstr+= " near <";
+		errstr+= toktypestr(*neartoken);
+		errstr+= "> '";
+		errstr+= neartoken->value;
+		errstr+= "'";
+	}
+	errlist.push_back(errstr);
+}
+
+
+void Compiler::compile_main(NodeList& nodes)
+{
+	Token<> tok(lex.getloosetoken());
+	while (tok.type != token_eof) {
+		compile_dotoken(nodes, tok);
+		lex.getloosetoken(tok);
+	}
+}
+
+
+/*
+ * Compile a brace enclosed {} block.
+ *
+ */
+void Compiler::compile_block(NodeList& nodes)
+{
+	cntguard<unsigned> gc(level);
+	Token<> tok(lex.getstricttoken());
+	// A block absolutely must start with an open brace '{'
+	if (tok.type != token_openbrace)
+		recorderror("Expected open brace '{'", &tok);
+
+	do {
+		lex.getloosetoken(tok);
+		switch (tok.type) {
+		case token_closebrace:
+			break;
+		case token_eof:
+			recorderror("Unexpected end of file");
+			break;
+		default:
+			compile_dotoken(nodes, tok);
+			break;
+		}
+	} while ( (tok.type != token_eof) && (tok.type != token_closebrace) );
+}
+
+
+/*
+ * Compile the body of a loop.  An @next or @last at the top level of
+ * the body ends the iteration immediately; when nested in a sub-block
+ * it ends the iteration after the enclosing top level statement.
+ *
+ */
+void Compiler::compile_loopblock(NodeList& nodes)
+{
+	cntguard<unsigned> gc(level), glc(looplevel);
+	Token<> tok(lex.getstricttoken());
+	if (tok.type != token_openbrace)
+		recorderror("Expected open brace '{'", &tok);
+
+	do {
+		lex.getloosetoken(tok);
+		switch (tok.type) {
+		case token_next:
+			nodes.push_back(new Node(Node::node_next, tok.lineno));
+			break;
+		case token_last:
+			nodes.push_back(new Node(Node::node_last, tok.lineno));
+			break;
+		case token_closebrace:
+			break;
+		case token_eof:
+			recorderror("Unexpected end of file");
+			break;
+		default:
+			compile_dotoken(nodes, tok);
+			break;
+		}
+	} while ( (tok.type != token_eof) && (tok.type != token_closebrace) );
+}
+
+
+/*
+ * Append literal text, merging it with any text node before it.
+ *
+ */
+void Compiler::addtext(NodeList& nodes, const std::string& text,
+	unsigned lineno)
+{
+	if (!nodes.empty() && (nodes.back()->type == Node::node_text))
+		nodes.back()->value+= text;
+	else
+	{
+		Node* node = new Node(Node::node_text, lineno);
+		node->value = text;
+		nodes.push_back(node);
+	}
+}
+
+
+void Compiler::compile_dotoken(NodeList& nodes, const Token<>& tok)
+{
+	switch (tok.type)
+	{
+	case token_eof:
+		recorderror("Unexpected end of file");
+		break;
+	case token_comment:
+	case token_joinline:
+		break;
+	case token_whitespace:
+	case token_text:
+	case token_escape:
+		addtext(nodes, tok.value, tok.lineno);
+		break;
+	case token_id:
+		{
+			Node* node = new Node(Node::node_symbol, tok.lineno);
+			node->value = tok.value;
+			nodes.push_back(node);
+		}
+		break;
+	case token_if:
+		compile_if(nodes, tok.lineno);
+		break;
+	case token_foreach:
+		compile_foreach(nodes, tok.lineno);
+		break;
+	case token_while:
+		compile_while(nodes, tok.lineno);
+		break;
+	case token_include:
+		compile_statement(nodes, Node::node_include, tok);
+		break;
+	case token_includetext:
+		compile_statement(nodes, Node::node_includetext, tok);
+		break;
+	case token_using:
+		compile_statement(nodes, Node::node_using, tok);
+		break;
+	case token_set:
+		compile_statement(nodes, Node::node_set, tok);
+		break;
+	case token_setif:
+		compile_statement(nodes, Node::node_setif, tok);
+		break;
+	case token_unset:
+		compile_statement(nodes, Node::node_unset, tok);
+		break;
+	case token_keys:
+		compile_statement(nodes, Node::node_keys, tok);
+		break;
+	case token_push:
+		compile_statement(nodes, Node::node_push, tok);
+		break;
+	case token_pop:
+		compile_statement(nodes, Node::node_pop, tok);
+		break;
+	case token_macro:
+		compile_macro(nodes, tok.lineno);
+		break;
+	case token_rand:
+	case token_empty:
+	case token_size:
+	case token_compare:
+	case token_isarray:
+	case token_ishash:
+	case token_isscalar:
+		compile_statement(nodes, Node::node_builtin, tok);
+		break;
+	case token_usermacro:
+		compile_statement(nodes, Node::node_call, tok);
+		break;
+	case token_next:
+		if (looplevel > 0)
+			nodes.push_back(new Node(Node::node_next, tok.lineno));
+		else
+			recorderror("Syntax error", &tok);
+		break;
+	case token_last:
+		if (looplevel > 0)
+			nodes.push_back(new Node(Node::node_last, tok.lineno));
+		else
+			recorderror("Syntax error", &tok);
+		break;
+	default:
+		recorderror("Syntax error", &tok);
+		break;
+	}
+}
+
+
+/*
+ * Compile a statement that takes a parameter list.
+ *
+ */
+void Compiler::compile_statement(NodeList& nodes, Node::node_types type,
+	const Token<>& tok)
+{
+	Node* node = new Node(type, tok.lineno);
+	node->builtin = tok.type;
+	node->value = tok.value;
+
+	bool failed;
+	switch (type)
+	{
+	case Node::node_set:
+	case Node::node_setif:
+	case Node::node_unset:
+	case Node::node_keys:
+	case Node::node_push:
+		failed = getidparamlist(node->value, node->params);
+		break;
+	case Node::node_pop:
+		failed = getidlist(node->ids);
+		break;
+	default:
+		failed = getparamlist(node->params);
+		break;
+	}
+	if (failed)
+	{
+		delete node;
+		return;
+	}
+	node->lineno = lex.getlineno();
+	nodes.push_back(node);
+}
+
+
+/*
+ * Compile one @if or @elsif condition and its block.
+ *
+ * @return	false on success;
+ * @return	true on failure, in which case the block is not consumed
+ *
+ */
+bool Compiler::compile_ifexpr(Node& node)
+{
+	ExprList pl;
+	if (getparamlist(pl))
+	{
+		deleteexprs(pl);
+		return true;
+	}
+	if (pl.empty())
+	{
+		recorderror("Syntax error, expected expression");
+		return true;
+	}
+	else if (pl.size() > 1)
+		recorderror("Warning: extra parameters ignored");
+
+	node.conds.push_back(pl);
+	node.blocks.push_back(NodeList());
+	compile_block(node.blocks.back());
+	return false;
+}
+
+
+void Compiler::compile_if(NodeList& nodes, unsigned lineno)
+{
+	Node* node = new Node(Node::node_if, lineno);
+	nodes.push_back(node);
+
+	compile_ifexpr(*node);
+
+	unsigned long saveindex = lex.index();
+	Token<> tok(lex.getstricttoken());
+	unsigned savelineno = tok.lineno;
+
+	while (tok.type == token_elsif)
+	{
+		compile_ifexpr(*node);
+		saveindex = lex.index();
+		lex.getstricttoken(tok);
+		savelineno = tok.lineno;
+	}
+
+	if (tok.type == token_else)
+	{
+		node->blocks.push_back(NodeList());
+		compile_block(node->blocks.back());
+	}
+	else
+	{
+		// unget token
+		lex.seek(saveindex);
+		lex.setlineno(savelineno);
+	}
+}
+
+
+void Compiler::compile_foreach(NodeList& nodes, unsigned lineno)
+{
+	Node* node = new Node(Node::node_foreach, lineno);
+	node->value = ".";
+	Token<> temp(lex.getstricttoken());
+
+	// Check for overide of default ID name
+	if (temp.type == token_id)
+		node->value = temp.value;
+	else
+		lex.unget(temp);
+
+	if (getparamlist(node->params))
+	{
+		delete node;
+		return;
+	}
+	node->lineno = lex.getlineno();
+	nodes.push_back(node);
+	node->blocks.push_back(NodeList());
+	compile_loopblock(node->blocks.back());
+}
+
+
+void Compiler::compile_while(NodeList& nodes, unsigned lineno)
+{
+	Node* node = new Node(Node::node_while, lineno);
+	if (getparamlist(node->params))
+	{
+		delete node;
+		return;
+	}
+	if (node->params.empty())
+	{
+		recorderror("Syntax error, expected expression");
+		delete node;
+		return;
+	}
+	else if (node->params.size() > 1)
+		recorderror("Warning: extra parameters ignored");
+
+	node->lineno = lex.getlineno();
+	nodes.push_back(node);
+	node->blocks.push_back(NodeList());
+	compile_loopblock(node->blocks.back());
+}
+
+
+/*
+ * Compile a macro definition.  The body is compiled once here rather
+ * than each time the macro is called.
+ *
+ */
+void Compiler::compile_macro(NodeList& nodes, unsigned lineno)
+{
+	if (level > 0)
+	{
+		recorderror("Macro may not be defined in sub-block");
+		return;
+	}
+	Token<> tok(lex.getstricttoken());
+	if (tok.type == token_eof)
+		return;
+	if (tok.type != token_openparen)
+	{
+		recorderror("Expected macro declaration");
+		return;
+	}
+	lex.getstricttoken(tok);
+	if (tok.type == token_eof)
+		return;
+	if (tok.type != token_id)
+	{
+		recorderror("Macro requires name parameter");
+		return;
+	}
+	std::string name(tok.value);
+	ParamList params;
+
+	lex.getstricttoken(tok);
+	while (tok.type == token_comma)
+	{
+		lex.getstricttoken(tok);
+		if (tok.type != token_id)
+		{
+			recorderror("Syntax error, expected identifier", &tok);
+			return;
+		}
+		if ((tok.value.find('{') != std::string::npos) ||
+				(tok.value.find('[') != std::string::npos))
+		{
+			recorderror("Syntax error, invalid parameter name", &tok);
+			return;
+		}
+		params.push_back(tok.value);
+		lex.getstricttoken(tok);
+
+		if (tok.type == token_closeparen)
+			break;
+		// The next token should be a comma or a close paren
+		if (tok.type != token_comma)
+		{
+			recorderror("Syntax error, expected comma or close parenthesis", &tok);
+			return;
+		}
+	}
+	if (tok.type == token_eof)
+	{
+		recorderror("Unexpected end of file");
+		return;
+	}
+	else if (tok.type != token_closeparen)
+	{
+		recorderror("Expected close parenthesis", &tok);
+		return;
+	}
+
+	std::string body;
+	unsigned bodyline;
+	if (lex.getblock(body, bodyline))
+	{
+		recorderror("Expected macro body {}");
+		return;
+	}
+	Node* node = new Node(Node::node_macro, lineno);
+	node->value = name;
+	node->ids = params;
+	node->code = Template(compilemacro(body, bodyline));
+	errlist.insert(errlist.end(), node->code.imp->errlist.begin(),
+		node->code.imp->errlist.end());
+	foldedexprs+= node->code.imp->foldedexprs;
+	droppedbranches+= node->code.imp->droppedbranches;
+	nodes.push_back(node);
+}
+
+
+/*
+ * Get a parenthesis enclosed, comma delimeted parameter list.
+ *
+ * @return	false on success;
+ * @return	true on failure
+ *
+ */
+bool Compiler::getparamlist(ExprList& pl)
+{
+	Token<> tok(lex.getstricttoken());
+	if (tok.type != token_openparen)
+	{
+		recorderror("Syntax error, parameters must be enclosed in "
+			"parenthesis", &tok);
+		return true;
+	}
+	lex.getstricttoken(tok);
+	return getexprlist(tok, pl);
+}
+
+
+/*
+ * Get a parenthesis enclosed, comma delimeted id and parameter list.
+ *
+ * @return	false on success;
+ * @return	true on failure
+ *
+ */
+bool Compiler::getidparamlist(std::string& id, ExprList& pl)
+{
+	Token<> tok(lex.getstricttoken());
+	if (tok.type != token_openparen)
+	{
+		recorderror("Syntax error, parameters must be enclosed in "
+			"parenthesis", &tok);
+		return true;
+	}
+	lex.getstricttoken(tok);
+	if (tok.type != token_id)
+	{
+		recorderror("Syntax error, expected id", &tok);
+		return true;
+	}
+	id = tok.value;
+	lex.getstricttoken(tok);
+	if (tok.type == token_comma)
+		lex.getstricttoken(tok);
+	return getexprlist(tok, pl);
+}
+
+
+/*
+ * Get a parenthesis enclosed, comma delimeted list of ids.
+ *
+ * @return	false on success;
+ * @return	true on failure
+ *
+ */
+bool Compiler::getidlist(std::vector< std::string >& ids)
+{
+	ids.clear();
+	Token<> tok(lex.getstricttoken());
+	if (tok.type != token_openparen)
+	{
+		recorderror("Syntax error, parameters must be enclosed in "
+			"parenthesis", &tok);
+		return true;
+	}
+
+	lex.getstricttoken(tok);
+	while ((tok.type != token_eof) && (tok.type != token_closeparen))
+	{
+		if (tok.type != token_id)
+		{
+			recorderror("Syntax error, expected id", &tok);
+			return true;
+		}
+		ids.push_back(tok.value);
+		lex.getstricttoken(tok);
+		// The next token should be a comma or a close paren
+		if (tok.type == token_closeparen)
+			break;
+		else if (tok.type != token_comma)
+		{
+			recorderror("Syntax error, expected comma or close parenthesis", &tok);
+			return true;
+		}
+		lex.getstricttoken(tok);
+	}
+
+	return false;
+}
+
+
+/*
+ * Compile comma delimited expressions up to the close parenthesis.
+ * tok holds the first token of the first expression.
+ *
+ */
+bool Compiler::getexprlist(Token<>& tok, ExprList& pl)
+{
+	while ((tok.type != token_eof) && (tok.type != token_closeparen))
+	{
+		pl.push_back(compile_level0(tok));
+
+		// The next token should be a comma or a close paren
+		if (tok.type == token_closeparen)
+			break;
+		else if (tok.type != token_comma)
+		{
+			recorderror("Syntax error, expected comma or close parenthesis", &tok);
+			return true;
+		}
+		lex.getstricttoken(tok);
+	}
+
+	return false;
+}
+
+} // end namespace TPT
@@ -0,0 +1,116 @@
+/*
+ * compile.h
+ *
+ * Template compiler
+ *
+ * Copyright (C) 2010 Isaac W. Foraker (isaac at noscience dot net)
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Author nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef include_libtpt_compile_h
+#define include_libtpt_compile_h
+
+#include "lexical.h"
+#include "template_impl.h"
+#include <libtpt/buffer.h>
+#include <string>
+#include <vector>
+
+namespace TPT {
+
+/*
+ * The Compiler walks a template with the same sequence of lexical
+ * calls that Parser_Impl uses to interpret it, but builds a tree of
+ * Nodes and Exprs instead of producing output.
+ */
+class Compiler {
+public:
+	Lex lex;
+	unsigned level;		// block level
+	unsigned looplevel;
+	ErrorList& errlist;
+	unsigned foldedexprs;		// expressions replaced by their value
+	unsigned droppedbranches;	// branches removed by constant conditions
+
+	Compiler(Buffer& buf, ErrorList& el) : lex(buf), level(0),
+		looplevel(0), errlist(el), foldedexprs(0), droppedbranches(0) {}
+	// Compile from the current position of another lexer
+	Compiler(const Lex& l, ErrorList& el) : lex(l), level(0),
+		looplevel(0), errlist(el), foldedexprs(0), droppedbranches(0) {}
+
+	void recorderror(const std::string& desc, const Token<>* neartoken=0);
+
+	void compile_main(NodeList& nodes);
+	void compile_block(NodeList& nodes);
+	void compile_loopblock(NodeList& nodes);
+	void compile_dotoken(NodeList& nodes, const Token<>& tok);
+	void addtext(NodeList& nodes, const std::string& text, unsigned lineno);
+
+	bool getparamlist(ExprList& pl);
+	bool getidparamlist(std::string& id, ExprList& pl);
+	bool getidlist(std::vector< std::string >& ids);
+	bool getexprlist(Token<>& tok, ExprList& pl);
+
+	bool compile_ifexpr(Node& node);
+	void compile_if(NodeList& nodes, unsigned lineno);
+	void compile_foreach(NodeList& nodes, unsigned lineno);
+	void compile_while(NodeList& nodes, unsigned lineno);
+	void compile_macro(NodeList& nodes, unsigned lineno);
+	void compile_statement(NodeList& nodes, Node::node_types type,
+		const Token<>& tok);
+
+	// Recursive descent expression compiler
+	Expr* compile_level0(Token<>& tok);
+	Expr* compile_level1(Token<>& tok);	// && || ^^
+	Expr* compile_level2(Token<>& tok);	// relational operators
+	Expr* compile_level3(Token<>& tok);	// + -
+	Expr* compile_level4(Token<>& tok);	// * / %
+	Expr* compile_level5(Token<>& tok);	// unary + - !
+	Expr* compile_level6(Token<>& tok);	// ( )
+	Expr* compile_level7(Token<>& tok);	// literals, ids, calls
+
+	// Constant folding and dead branch removal
+	void foldnodes(NodeList& nodes);
+	void foldexprs(ExprList& exprs);
+	void foldexpr(Expr& expr);
+	void foldif(Node& node);
+
+private:
+	Compiler(const Compiler&);
+	Compiler& operator=(const Compiler&);
+};
+
+Template_Impl* compiletemplate(Buffer& buf);
+Template_Impl* compilemacro(const std::string& body, unsigned lineno);
+void lowertemplate(const NodeList& nodes, Program& prog);
+bool hasloopcmd(const NodeList& nodes);
+
+} // end namespace TPT
+
+#endif // include_libtpt_compile_h
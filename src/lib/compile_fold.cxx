@@ -0,0 +1,374 @@
+/*
+ * compile_fold.cxx
+ *
+ * Constant folding and dead branch removal
+ *
+ * Copyright (C) 2010 Isaac W. Foraker (isaac at noscience dot net)
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Author nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "conf.h"
+#include "compile.h"
+#include "funcs.h"
+#include <libtpt/object.h>
+#include <sstream>
+
+namespace TPT {
+
+/*
+ * Once a template is compiled, expressions made only of literals,
+ * operators and the pure built-in functions below are replaced by their
+ * value, and @if branches and @while loops whose condition is constant
+ * are removed or inlined.  Folded values are computed the same way the
+ * VM computes them at render time.
+ *
+ */
+
+namespace {
+
+typedef bool (*PureFunc)(std::ostream&, Object&);
+
+// Built-in functions whose result depends only on their parameters
+PureFunc findpurefunc(const std::string& name)
+{
+	static const struct {
+		const char* name;
+		PureFunc func;
+	} purefuncs[] = {
+		{ "@length", func_length },
+		{ "@uc", func_uc },
+		{ "@lc", func_lc },
+		{ "@concat", func_concat },
+		{ "@eval", func_concat },
+		{ 0, 0 }
+	};
+	for (unsigned i = 0; purefuncs[i].name; ++i)
+		if (name == purefuncs[i].name)
+			return purefuncs[i].func;
+	return 0;
+}
+
+
+bool isliteral(const Expr* expr)
+{
+	return expr->type == Expr::expr_literal;
+}
+
+
+bool allliteral(const ExprList& exprs)
+{
+	ExprList::const_iterator it(exprs.begin()), end(exprs.end());
+	for (; it != end; ++it)
+		if (!isliteral(*it))
+			return false;
+	return true;
+}
+
+
+// Call a pure function on literal parameters
+bool callpurefunc(PureFunc func, const ExprList& args, std::string& result)
+{
+	Object params(Object::type_array);
+	ExprList::const_iterator it(args.begin()), end(args.end());
+	for (; it != end; ++it)
+		params.array().push_back(new Object((*it)->tok.value));
+	std::stringstream os;
+	// Errors are left to be reported when the template is rendered
+	if (func(os, params))
+		return true;
+	result = os.str();
+	return false;
+}
+
+
+// Replace an expression with a literal value
+void setliteral(Expr& expr, const std::string& value)
+{
+	deleteexprs(expr.args);
+	expr.type = Expr::expr_literal;
+	expr.tok.type = token_string;
+	expr.tok.op = oper_none;
+	expr.tok.value = value;
+}
+
+
+// Append a node, joining it to a text node before it
+void appendnode(NodeList& nodes, Node* node)
+{
+	if ((node->type == Node::node_text) && !nodes.empty() &&
+		(nodes.back()->type == Node::node_text))
+	{
+		nodes.back()->value+= node->value;
+		delete node;
+	}
+	else
+		nodes.push_back(node);
+}
+
+} // end anonymous namespace
+
+
+void Compiler::foldexprs(ExprList& exprs)
+{
+	ExprList::iterator it(exprs.begin()), end(exprs.end());
+	for (; it != end; ++it)
+		foldexpr(**it);
+}
+
+
+void Compiler::foldexpr(Expr& expr)
+{
+	foldexprs(expr.args);
+
+	std::string value;
+	switch (expr.type)
+	{
+	case Expr::expr_unary:
+		{
+			if (!isliteral(expr.args[0]))
+				return;
+			int64_t work = str2num(expr.args[0]->tok.value.c_str());
+			if (expr.tok.op == oper_not)
+				work = !work;
+			else if (expr.tok.op == oper_sub)
+				work = -work;
+			num2str(work, value);
+		}
+		break;
+	case Expr::expr_binary:
+		{
+			if (!isliteral(expr.args[0]))
+				return;
+			OperatorKinds op = expr.tok.op;
+			int64_t lwork = str2num(expr.args[0]->tok.value.c_str());
+			// The right side of && and || is not needed when the left
+			// side decides the result
+			if (((op == oper_and) && !lwork) || ((op == oper_or) && lwork))
+			{
+				setliteral(expr, (op == oper_or) ? "1" : "0");
+				++foldedexprs;
+				return;
+			}
+			if (!isliteral(expr.args[1]))
+				return;
+			int64_t rwork = str2num(expr.args[1]->tok.value.c_str());
+			switch (op)
+			{
+			case oper_and:
+			case oper_or:
+				lwork = !!rwork;
+				break;
+			case oper_xor:
+				lwork = !lwork ^ !rwork;
+				break;
+			case oper_eq:
+				lwork = lwork == rwork;
+				break;
+			case oper_ne:
+				lwork = lwork != rwork;
+				break;
+			case oper_lt:
+				lwork = lwork < rwork;
+				break;
+			case oper_gt:
+				lwork = lwork > rwork;
+				break;
+			case oper_le:
+				lwork = lwork <= rwork;
+				break;
+			case oper_ge:
+				lwork = lwork >= rwork;
+				break;
+			case oper_add:
+				lwork+= rwork;
+				break;
+			case oper_sub:
+				lwork-= rwork;
+				break;
+			case oper_mul:
+				lwork*= rwork;
+				break;
+			case oper_div:
+				if (!rwork)
+					return;
+				lwork/= rwork;
+				break;
+			case oper_mod:
+				if (!rwork)
+					return;
+				lwork%= rwork;
+				break;
+			default:
+				break;
+			}
+			num2str(lwork, value);
+		}
+		break;
+	case Expr::expr_call:
+		{
+			PureFunc func = findpurefunc(expr.tok.value);
+			if (!func || !allliteral(expr.args) ||
+				callpurefunc(func, expr.args, value))
+				return;
+		}
+		break;
+	default:
+		return;
+	}
+	setliteral(expr, value);
+	++foldedexprs;
+}
+
+
+/*
+ * Remove the branches of an @if that can never be taken.  A branch whose
+ * condition is always true becomes the else branch.
+ *
+ */
+void Compiler::foldif(Node& node)
+{
+	size_t i = 0;
+	while (i < node.conds.size())
+	{
+		ExprList& cond = node.conds[i];
+		// Only the first of several parameters is tested, but the rest
+		// are still evaluated
+		if ((cond.size() != 1) || !isliteral(cond[0]))
+		{
+			++i;
+			continue;
+		}
+		bool istrue = str2num(cond[0]->tok.value.c_str()) != 0;
+		deleteexprs(cond);
+		node.conds.erase(node.conds.begin() + i);
+		if (!istrue)
+		{
+			deletenodes(node.blocks[i]);
+			node.blocks.erase(node.blocks.begin() + i);
+			++droppedbranches;
+			continue;
+		}
+		// Everything after this branch is unreachable
+		for (size_t j = i+1; j < node.blocks.size(); ++j)
+		{
+			deletenodes(node.blocks[j]);
+			++droppedbranches;
+		}
+		node.blocks.resize(i+1);
+		for (size_t j = i; j < node.conds.size(); ++j)
+			deleteexprs(node.conds[j]);
+		node.conds.resize(i);
+		break;
+	}
+}
+
+
+/*
+ * Fold the expressions in a list of nodes and remove dead branches.
+ *
+ */
+void Compiler::foldnodes(NodeList& nodes)
+{
+	NodeList folded;
+	NodeList::iterator it(nodes.begin()), end(nodes.end());
+	for (; it != end; ++it)
+	{
+		Node* node = *it;
+		foldexprs(node->params);
+		std::vector< ExprList >::iterator cit(node->conds.begin()),
+			cend(node->conds.end());
+		for (; cit != cend; ++cit)
+			foldexprs(*cit);
+
+		// Dead branches are dropped before their blocks are folded
+		if (node->type == Node::node_if)
+			foldif(*node);
+		else if ((node->type == Node::node_while) &&
+			(node->params.size() == 1) && isliteral(node->params[0]) &&
+			!str2num(node->params[0]->tok.value.c_str()))
+		{
+			// The loop body can never run
+			delete node;
+			++droppedbranches;
+			continue;
+		}
+		std::vector< NodeList >::iterator bit(node->blocks.begin()),
+			bend(node->blocks.end());
+		for (; bit != bend; ++bit)
+			foldnodes(*bit);
+
+		switch (node->type)
+		{
+		case Node::node_call:
+			{
+				// A call to a pure function becomes text
+				PureFunc func = findpurefunc(node->value);
+				std::string value;
+				if (func && allliteral(node->params) &&
+					!callpurefunc(func, node->params, value))
+				{
+					deleteexprs(node->params);
+					node->type = Node::node_text;
+					node->value = value;
+					++foldedexprs;
+				}
+			}
+			break;
+		case Node::node_if:
+			if (!node->conds.empty())
+				break;
+			if (node->blocks.empty())
+			{
+				// No branch can be taken
+				delete node;
+				continue;
+			}
+			// Only the else branch is left.  A nested @next or @last
+			// behaves differently at the top of a loop body, so such a
+			// block stays inside the @if.
+			if (!hasloopcmd(node->blocks[0]))
+			{
+				NodeList& block = node->blocks[0];
+				NodeList::iterator nit(block.begin()), nend(block.end());
+				for (; nit != nend; ++nit)
+					appendnode(folded, *nit);
+				block.clear();
+				delete node;
+				continue;
+			}
+			break;
+		default:
+			break;
+		}
+		appendnode(folded, node);
+	}
+	nodes.swap(folded);
+}
+
+} // end namespace TPT
@@ -0,0 +1,200 @@
+/*
+ * compile_rd.cxx
+ *
+ * Recursive descent expression compiler
+ *
+ * Copyright (C) 2010 Isaac W. Foraker (isaac at noscience dot net)
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Author nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "conf.h"
+#include "compile.h"
+
+namespace TPT {
+
+
+/*
+ * The expression compiler follows the same grammar as the recursive
+ * descent parser in parse_impl_rd.cxx.  On entry tok holds the first
+ * token of the expression; on return it holds the first token after
+ * the expression, which will usually be a comma ',', or close
+ * parenthesis ')'.
+ *
+ */
+
+namespace {
+
+Expr* makebinary(const Token<>& op, Expr* left, Expr* right)
+{
+	Expr* expr = new Expr(Expr::expr_binary, op);
+	expr->args.push_back(left);
+	expr->args.push_back(right);
+	return expr;
+}
+
+} // end anonymous namespace
+
+// Level 0: Get things rolling
+Expr* Compiler::compile_level0(Token<>& tok)
+{
+	if (tok.type == token_eof)
+	{
+		recorderror("Unexpected end of file");
+		return new Expr(Expr::expr_token, tok);
+	}
+	return compile_level1(tok);
+}
+
+// Level 1: && || ^^
+Expr* Compiler::compile_level1(Token<>& tok)
+{
+	Expr* left = compile_level2(tok);
+	while ((tok.op == oper_and) || (tok.op == oper_or) ||
+		(tok.op == oper_xor))
+	{
+		Token<> op(tok);
+		lex.getstricttoken(tok);
+		left = makebinary(op, left, compile_level2(tok));
+	}
+	return left;
+}
+
+// Level 2: == != < > <= >=
+Expr* Compiler::compile_level2(Token<>& tok)
+{
+	Expr* left = compile_level3(tok);
+	while (tok.type == token_relop)
+	{
+		Token<> op(tok);
+		lex.getstricttoken(tok);
+		left = makebinary(op, left, compile_level3(tok));
+	}
+	return left;
+}
+
+// Level 3: + -
+Expr* Compiler::compile_level3(Token<>& tok)
+{
+	Expr* left = compile_level4(tok);
+	while ((tok.op == oper_add) || (tok.op == oper_sub))
+	{
+		Token<> op(tok);
+		lex.getstricttoken(tok);
+		left = makebinary(op, left, compile_level4(tok));
+	}
+	return left;
+}
+
+// Level 4: * / %
+Expr* Compiler::compile_level4(Token<>& tok)
+{
+	Expr* left = compile_level5(tok);
+	while ((tok.op == oper_mul) || (tok.op == oper_div) ||
+		(tok.op == oper_mod))
+	{
+		Token<> op(tok);
+		lex.getstricttoken(tok);
+		left = makebinary(op, left, compile_level5(tok));
+	}
+	return left;
+}
+
+// Level 5: + - ! (unary operators)
+Expr* Compiler::compile_level5(Token<>& tok)
+{
+	if ((tok.op == oper_add) || (tok.op == oper_sub) ||
+		(tok.op == oper_not))
+	{
+		Expr* expr = new Expr(Expr::expr_unary, tok);
+		lex.getstricttoken(tok);
+		expr->args.push_back(compile_level6(tok));
+		return expr;
+	}
+	return compile_level6(tok);
+}
+
+// Level 6: ( )
+Expr* Compiler::compile_level6(Token<>& tok)
+{
+	if (tok.type != token_openparen)
+		return compile_level7(tok);
+
+	lex.getstricttoken(tok);
+	Expr* expr = compile_level0(tok);
+	if (tok.type != token_closeparen)
+		recorderror("Syntax error, expected )");
+	else
+		// get token after close paren
+		lex.getstricttoken(tok);
+	return expr;
+}
+
+// Level 7: literals $id @macro
+Expr* Compiler::compile_level7(Token<>& tok)
+{
+	Expr* expr;
+	switch (tok.type) {
+	case token_id:
+		expr = new Expr(Expr::expr_symbol, tok);
+		break;
+	case token_usermacro:
+	case token_compare:
+	case token_empty:
+	case token_isarray:
+	case token_ishash:
+	case token_isscalar:
+	case token_rand:
+	case token_size:
+		expr = new Expr((tok.type == token_usermacro) ? Expr::expr_call :
+			Expr::expr_builtin, tok);
+		if (getparamlist(expr->args))
+		{
+			// A call with bad parameters evaluates to an empty string
+			delete expr;
+			Token<> empty(tok);
+			empty.type = token_string;
+			empty.value.erase();
+			expr = new Expr(Expr::expr_literal, empty);
+		}
+		break;
+	case token_integer:
+	case token_string:
+		expr = new Expr(Expr::expr_literal, tok);
+		break;
+	default:
+		// This may be a unary operator or parenthesis
+		expr = new Expr(Expr::expr_token, tok);
+		break;
+	}
+	// Return next available token
+	lex.getstricttoken(tok);
+	return expr;
+}
+
+} // end namespace TPT
@@ -43,7 +43,7 @@ namespace TPT {
 
 std::string eval(const std::string& expr, const Symbols* sym)
 {
-	Buffer buf(expr.c_str(), expr.size());
+	Buffer buf(expr.c_str(), expr.size(), Buffer::borrow);
 	if (sym)
 	{
 		Parser p(buf, *sym);
@@ -62,11 +62,11 @@ bool func_sum(std::ostream& os, TPT::Object& params)
 			{
 				Object& subobj = *(*it).get();
 				if (subobj.gettype() == Object::type_scalar)
-					lwork+= str2num(subobj.scalar().c_str());
+					lwork+= subobj.integer();
 			}
 		}
 		else if (obj.gettype() == Object::type_scalar)
-			lwork+= str2num(obj.scalar().c_str());
+			lwork+= obj.integer();
 		else
 			iserr = true;
 	}
@@ -98,14 +98,14 @@ bool func_avg(std::ostream& os, TPT::Object& params)
 				Object& subobj = *(*it).get();
 				if (subobj.gettype() == Object::type_scalar)
 				{
-					lwork+= str2num(subobj.scalar().c_str());
+					lwork+= subobj.integer();
 					++count;
 				}
 			}
 		}
 		else if (obj.gettype() == Object::type_scalar)
 		{
-			lwork+= str2num(obj.scalar().c_str());
+			lwork+= obj.integer();
 			++count;
 		}
 		else
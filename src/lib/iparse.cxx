@@ -79,6 +79,17 @@ IParser::IParser(Buffer& buf, Symbols& st)
     imp = new Parser_Impl(buf, st);
 }
 
+/**
+ * Construct a IParser for a compiled Template and Symbols table.
+ *
+ * @param   t           Reference to compiled Template.
+ * @param   st          Reference to Symbols table.
+ */
+IParser::IParser(const Template& t, Symbols& st)
+{
+    imp = new Parser_Impl(t, st);
+}
+
 /**
  * Destruct this IParser.
  *
@@ -170,6 +181,21 @@ bool IParser::geterrorlist(ErrorList& errlist)
 void IParser::addincludepath(const char* path)
 {
     imp->inclist.push_back(path);
+    imp->includes.clear();
+}
+
+
+/**
+ * Share compiled include files through a TemplateCache, so that files
+ * included by many parsers are read and compiled once.  By default,
+ * each parser compiles the files it includes.
+ *
+ * @param   cache   Cache to use for included files.
+ * @return  nothing
+ */
+void IParser::setincludecache(TemplateCache& cache)
+{
+    imp->inccache = &cache;
 }
 
 
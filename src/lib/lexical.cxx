@@ -50,6 +50,77 @@
 #include <iostream>
 #include <cctype>
 
+#if defined(__SSE2__) || defined(_M_X64) || \
+	(defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#	include <emmintrin.h>
+#	define TPT_USE_SSE2
+#endif
+
+namespace {
+
+/*
+ * Check for a character that ends a run of raw text.
+ */
+inline bool istextend(char c)
+{
+	switch (c) {
+	case '$':
+	case '@':
+	case '\\':
+	case '{':
+	case '}':
+	case '\r':
+	case '\n':
+	case ' ':
+	case '\t':
+	case '\0':
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Get the length of the run of raw text at the start of s.  With SSE2,
+ * sixteen characters are checked at a time; control characters are
+ * matched loosely there and checked again one at a time.
+ */
+unsigned long textspan(const char* s, unsigned long len)
+{
+	unsigned long i = 0;
+#ifdef TPT_USE_SSE2
+	const __m128i space = _mm_set1_epi8(' ');
+	const __m128i dollar = _mm_set1_epi8('$');
+	const __m128i at = _mm_set1_epi8('@');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i openbrace = _mm_set1_epi8('{');
+	const __m128i closebrace = _mm_set1_epi8('}');
+	for (; i + 16 <= len; i+= 16)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+		// v <= ' ' catches space, tab, returns and nul.
+		__m128i m = _mm_cmpeq_epi8(_mm_min_epu8(v, space), v);
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(v, dollar));
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(v, at));
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(v, backslash));
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(v, openbrace));
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(v, closebrace));
+		if (_mm_movemask_epi8(m))
+		{
+			for (unsigned long j = i; j < i + 16; ++j)
+				if (istextend(s[j]))
+					return j;
+		}
+	}
+#endif
+	for (; i < len; ++i)
+		if (istextend(s[i]))
+			break;
+	return i;
+}
+
+} // end anonymous namespace
+
 namespace TPT {
 
 
@@ -64,15 +135,32 @@ void Lex::setlineno(unsigned newline)
 }
 
 
+/*
+ * The token getters fill a caller's token in place, so a caller that
+ * reads tokens in a loop reuses the storage of the token's value rather
+ * than allocating a new string for every token.
+ *
+ */
 Token<> Lex::getloosetoken()
+{
+	Token<> t;
+	getloosetoken(t);
+	return t;
+}
+
+
+void Lex::getloosetoken(Token<>& t)
 {
 	char c;
 
+	t.column = column_;
+	t.lineno = lineno_;
+	t.op = oper_none;
+	t.value.erase();
 	if (!(c = safeget()))
 	{
-		Token<> t(column_, lineno_);
 		t.type = token_eof;	
-		return t;
+		return;
 	}
 
 	// Check for #! on the first line, and ignore
@@ -81,7 +169,6 @@ Token<> Lex::getloosetoken()
 		c = safeget();
 		if (c == '!')
 		{
-			Token<> t(column_, lineno_);
 			// Ignore this line
 			while ( (c = safeget()) )
 			{
@@ -94,7 +181,7 @@ Token<> Lex::getloosetoken()
 			}
 			t.type = token_comment;
 			t.value.erase();
-			return t;
+			return;
 		}
 		else if (c)
 			safeunget();
@@ -114,33 +201,49 @@ Token<> Lex::getloosetoken()
 	case '{':	// start block
 	case '}':	// end block
 		safeunget();
-		return getspecialtoken();
+		getspecialtoken(t);
+		return;
 	default:
 		break;
 	}
-	Token<> t(column_, lineno_);
+	t.column = column_;
 	t.type = token_text;
 	t.value = c;
 	buildrawtext(t.value);
+}
 
+
+Token<> Lex::getstricttoken()
+{
+	Token<> t;
+	getstricttoken(t);
 	return t;
 }
 
 
-Token<> Lex::getstricttoken()
+void Lex::getstricttoken(Token<>& t)
 {
-	Token<> t(getspecialtoken());
+	getspecialtoken(t);
 	// skip white-spaces
 	while ((t.type == token_whitespace) || (t.type == token_comment))
-		t = getspecialtoken();
+		getspecialtoken(t);
+}
+
 
+Token<> Lex::getspecialtoken()
+{
+	Token<> t;
+	getspecialtoken(t);
 	return t;
 }
 
 
-Token<> Lex::getspecialtoken()
+void Lex::getspecialtoken(Token<>& t)
 {
-	Token<> t(column_, lineno_);
+	t.column = column_;
+	t.lineno = lineno_;
+	t.op = oper_none;
+	t.value.erase();
 	t.type = token_error;
 	char c;
 	unsigned col = column_;
@@ -148,7 +251,7 @@ Token<> Lex::getspecialtoken()
 	if (!(c = safeget()))
 	{
 		t.type = token_eof;	
-		return t;
+		return;
 	}
 
 	// Check for #! on the first line, and ignore
@@ -169,7 +272,7 @@ Token<> Lex::getspecialtoken()
 			}
 			t.type = token_comment;
 			t.value.erase();
-			return t;
+			return;
 		}
 		else if (c)
 			safeunget();
@@ -197,11 +300,24 @@ Token<> Lex::getspecialtoken()
 		t.type = token_comma;
 		break;
 	case '+':
+		t.type = token_operator;
+		t.op = oper_add;
+		break;
 	case '-':
+		t.type = token_operator;
+		t.op = oper_sub;
+		break;
 	case '*':
+		t.type = token_operator;
+		t.op = oper_mul;
+		break;
 	case '/':
+		t.type = token_operator;
+		t.op = oper_div;
+		break;
 	case '%':
 		t.type = token_operator;
+		t.op = oper_mod;
 		break;
 	case '|':
 	case '&':
@@ -211,6 +327,7 @@ Token<> Lex::getspecialtoken()
 		{
 			// as in ||, &&, ^^
 			t.type = token_operator;
+			t.op = (c == '&') ? oper_and : (c == '|') ? oper_or : oper_xor;
 			t.value+= c;
 		}
 		else if (c) // error, no support for binary ops
@@ -237,7 +354,7 @@ Token<> Lex::getspecialtoken()
 				{
 					safeunget();
 					safeunget();
-					t = getspecialtoken();
+					getspecialtoken(t);
 				}
 				// Check for truncate whitespace
 				else if (c == '<')
@@ -287,7 +404,7 @@ Token<> Lex::getspecialtoken()
 		if (std::isalpha(c) || c == '_' || c == '.')
 		{
 			buildidentifier(t.value);
-			t.type = checkreserved(t.value.c_str() + 1);
+			t.type = checkreserved(t.value.data() + 1, t.value.size() - 1);
 		}
 		else if (c == '#') // this is a @# comment
 			buildcomment(t);
@@ -311,7 +428,7 @@ Token<> Lex::getspecialtoken()
 		{
 			if (c) safeunget();
 			t.type = token_text;
-			return t;
+			return;
 		}
 		break;
 	case '$':	// variable name
@@ -322,11 +439,13 @@ Token<> Lex::getspecialtoken()
 		if (c == '=')
 		{
 			t.type = token_relop;
+			t.op = oper_ne;
 			t.value+= c;
 		}
 		else
 		{
 			t.type = token_operator;
+			t.op = oper_not;
 			if (c) safeunget();
 		}
 		break;
@@ -336,9 +455,17 @@ Token<> Lex::getspecialtoken()
 		t.type = token_relop;
 		c = safeget();
 		if (c == '=')
+		{
 			t.value+= c;
+			t.op = (t.value[0] == '>') ? oper_ge :
+				(t.value[0] == '<') ? oper_le : oper_eq;
+		}
 		else
+		{
 			if (c) safeunget();
+			t.op = (t.value[0] == '>') ? oper_gt :
+				(t.value[0] == '<') ? oper_lt : oper_none;
+		}
 		break;
 	default: t.type = token_error; break;
 	}
@@ -357,7 +484,7 @@ Token<> Lex::getspecialtoken()
 		}
 	}
 
-	return t;
+	return;
 }
 
 
@@ -387,7 +514,7 @@ bool Lex::getblock(std::string& block, unsigned& lineno)
 
 	// Ignore all whitespace before the opening brace;
 	while (t.type == token_whitespace)
-		t = getloosetoken();
+		getloosetoken(t);
 
 	// If the current token is not an open brace then something is wrong, so
 	// abort this function.
@@ -404,7 +531,7 @@ bool Lex::getblock(std::string& block, unsigned& lineno)
 	// Iterate through the buffer until the close brace for this block is found
 	do
 	{
-		t = getloosetoken();
+		getloosetoken(t);
 		if (t.type == token_eof)
 			return true;
 		// Preserve escaped sequences
@@ -435,7 +562,7 @@ bool Lex::ignoreblock()
 
 	// Ignore all whitespace before the opening brace;
 	while (t.type == token_whitespace)
-		t = getloosetoken();
+		getloosetoken(t);
 
 	// If the current token is not an open brace, then something is
 	// wrong, so abort this function.
@@ -450,7 +577,7 @@ bool Lex::ignoreblock()
 	// Iterate through the buffer until the close brace for this block is found
 	do
 	{
-		t = getloosetoken();
+		getloosetoken(t);
 		if (t.type == token_eof)
 			return true;
 		else if (t.type == token_openbrace)
@@ -478,6 +605,34 @@ bool Lex::seek(unsigned long index)
 	return buf_.seek(index);
 }
 
+/*
+ * Tell the buffer that nothing before the current position will be
+ * read again, so a window stream may drop it.
+ *
+ */
+void Lex::discard()
+{
+	buf_.discard(buf_.offset());
+}
+
+void Lex::getstate(State& s) const
+{
+	s.index = buf_.offset();
+	s.lineno = lineno_;
+	s.column = column_;
+	s.ignoreindent = ignoreindent_;
+	s.ignoreblankline = ignoreblankline_;
+}
+
+void Lex::setstate(const State& s)
+{
+	buf_.seek(s.index);
+	lineno_ = s.lineno;
+	column_ = s.column;
+	ignoreindent_ = s.ignoreindent;
+	ignoreblankline_ = s.ignoreblankline;
+}
+
 /*
  * Handle whitespace and comment following brace
  */
@@ -526,114 +681,123 @@ void Lex::handlebraceignore(Token<>& t)
 	}
 }
 
+namespace {
+
+enum pragma_types {
+	pragma_none,
+	pragma_ignoreblankline,
+	pragma_noignoreblankline,
+	pragma_ignoreindent,
+	pragma_noignoreindent
+};
+
+struct Reserved {
+	const char* name;
+	unsigned len;
+	TokenTypes type;
+	pragma_types pragma;
+};
+
+// Reserved words, without the leading @
+const Reserved reserved[] = {
+	{ "compare",	7,	token_compare,	pragma_none },
+	{ "comp",	4,	token_compare,	pragma_none },
+	{ "else",	4,	token_else,	pragma_none },
+	{ "elsif",	5,	token_elsif,	pragma_none },
+	{ "empty",	5,	token_empty,	pragma_none },
+	{ "foreach",	7,	token_foreach,	pragma_none },
+	{ "if",	2,	token_if,	pragma_none },
+	{ "include",	7,	token_include,	pragma_none },
+	{ "includetext",	11,	token_includetext,	pragma_none },
+	{ "isarray",	7,	token_isarray,	pragma_none },
+	{ "ishash",	6,	token_ishash,	pragma_none },
+	{ "isscalar",	8,	token_isscalar,	pragma_none },
+	{ "ignoreblankline",	15,	token_comment,	pragma_ignoreblankline },
+	{ "ignoreindent",	12,	token_comment,	pragma_ignoreindent },
+	{ "keys",	4,	token_keys,	pragma_none },
+	{ "last",	4,	token_last,	pragma_none },
+	{ "macro",	5,	token_macro,	pragma_none },
+	{ "next",	4,	token_next,	pragma_none },
+	{ "noignoreindent",	14,	token_comment,	pragma_noignoreindent },
+	{ "noignoreblankline",	17,	token_comment,	pragma_noignoreblankline },
+	{ "pop",	3,	token_pop,	pragma_none },
+	{ "push",	4,	token_push,	pragma_none },
+	{ "rand",	4,	token_rand,	pragma_none },
+	{ "set",	3,	token_set,	pragma_none },
+	{ "setif",	5,	token_setif,	pragma_none },
+	{ "size",	4,	token_size,	pragma_none },
+	{ "strcmp",	6,	token_compare,	pragma_none },
+	{ "tpt_ignoreblankline",	19,	token_comment,	pragma_ignoreblankline },
+	{ "tpt_ignoreindent",	16,	token_comment,	pragma_ignoreindent },
+	{ "tpt_noignoreindent",	18,	token_comment,	pragma_noignoreindent },
+	{ "tpt_noignoreblankline",	21,	token_comment,	pragma_noignoreblankline },
+	{ "unset",	5,	token_unset,	pragma_none },
+	{ "using",	5,	token_using,	pragma_none },
+	{ "while",	5,	token_while,	pragma_none },
+};
+
+const unsigned RESERVED_MAXLEN = 21;
+
+/*
+ * Perfect hash of the reserved words into reservedslot.  The constants
+ * were found by search so that no two words collide; check that any
+ * word added to reserved[] still gets a free slot.
+ */
+inline unsigned reservedhash(const char* str, unsigned len)
+{
+	const unsigned char* s = reinterpret_cast<const unsigned char*>(str);
+	return (len + s[0] + 5*s[len-1] + 2*s[len/2]) & 127;
+}
+
+// Index into reserved[] for each hash value, or -1
+const signed char reservedslot[128] = {
+	 8, 20, -1, -1, 23, -1, -1, -1, -1, -1, 18, 13, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 15, -1, -1, -1, -1, -1,
+	14, -1, -1, -1, 31, -1, 17,  4, 29, -1, -1, -1, 28, -1, -1, -1,
+	-1,  9, -1, -1, -1,  6, -1, -1, -1, 10, -1, -1, 19, -1, -1,  5,
+	-1,  7, -1,  0, -1, -1, 22, 33,  2, 12, 27, -1, -1, -1,  3, 32,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 24, -1,
+	-1, -1, 21, 16, 25, -1, 30, -1, -1, -1, -1, -1, -1, 11, -1, 26,
+	-1,  1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+};
+
+} // end anonymous namespace
+
 /*
  * Check a function token to see if it is a reserved word, assuming the
- * prepending @ is excluded.
+ * leading @ has been stripped.  A word is found with one hash and one
+ * compare; anything else is a user macro.
  *
  */
-Token<>::en Lex::checkreserved(const char* str)
+Token<>::en Lex::checkreserved(const char* str, unsigned len)
 {
-	// Should not be in this function unless str[0] == '@'
-	switch (*str)
+	if (!len || (len > RESERVED_MAXLEN))
+		return token_usermacro;
+	int i = reservedslot[reservedhash(str, len)];
+	if (i < 0)
+		return token_usermacro;
+	const Reserved& r = reserved[i];
+	if ((r.len != len) || std::memcmp(r.name, str, len))
+		return token_usermacro;
+
+	switch (r.pragma)
 	{
-	case 'c':
-		if (!std::strcmp(str, "compare"))	return token_compare;
-		if (!std::strcmp(str, "comp"))		return token_compare;
+	case pragma_ignoreblankline:
+		ignoreblankline_ = true;
 		break;
-	case 'e':
-		if (!std::strcmp(str, "else"))		return token_else;
-		if (!std::strcmp(str, "elsif"))		return token_elsif;
-		if (!std::strcmp(str, "empty"))		return token_empty;
+	case pragma_noignoreblankline:
+		ignoreblankline_ = false;
 		break;
-	case 'f':
-		if (!std::strcmp(str, "foreach"))	return token_foreach;
-		break;
-	case 'i':
-		if (!std::strcmp(str, "if"))		return token_if;
-		if (!std::strcmp(str, "include"))	return token_include;
-		if (!std::strcmp(str, "includetext"))	return token_includetext;
-		if (!std::strcmp(str, "isarray"))	return token_isarray;
-		if (!std::strcmp(str, "ishash"))	return token_ishash;
-		if (!std::strcmp(str, "isscalar"))	return token_isscalar;
-		if (!std::strcmp(str, "ignoreblankline"))
-		{
-			ignoreblankline_ = true;
-			return token_comment;
-		}
-		else if (!std::strcmp(str, "ignoreindent"))
-		{
-			ignoreindent_ = true;
-			return token_comment;
-		}
+	case pragma_ignoreindent:
+		ignoreindent_ = true;
 		break;
-	case 'k':
-		if (!std::strcmp(str, "keys"))		return token_keys;
-		break;
-	case 'l':
-		if (!std::strcmp(str, "last"))		return token_last;
-		break;
-	case 'm':
-		if (!std::strcmp(str, "macro"))		return token_macro;
-		break;
-	case 'n':
-		if (!std::strcmp(str, "next"))		return token_next;
-		if (!std::strcmp(str, "noignoreindent"))
-		{
-			ignoreindent_ = false;
-			return token_comment;
-		}
-		else if (!std::strcmp(str, "noignoreblankline"))
-		{
-			ignoreblankline_ = false;
-			return token_comment;
-		}
-		break;
-	case 'p':
-		if (!std::strcmp(str, "pop"))		return token_pop;
-		if (!std::strcmp(str, "push"))		return token_push;
-		break;
-	case 'r':
-		if (!std::strcmp(str, "rand"))		return token_rand;
-		break;
-	case 's':
-		if (!std::strcmp(str, "set"))		return token_set;
-		if (!std::strcmp(str, "setif"))		return token_setif;
-		if (!std::strcmp(str, "size"))		return token_size;
-		if (!std::strcmp(str, "strcmp"))	return token_compare;
-		break;
-	case 't':
-		if (!std::strcmp(str, "tpt_ignoreblankline"))
-		{
-			ignoreblankline_ = true;
-			return token_comment;
-		}
-		else if (!std::strcmp(str, "tpt_ignoreindent"))
-		{
-			ignoreindent_ = true;
-			return token_comment;
-		}
-		if (!std::strcmp(str, "tpt_noignoreindent"))
-		{
-			ignoreindent_ = false;
-			return token_comment;
-		}
-		else if (!std::strcmp(str, "tpt_noignoreblankline"))
-		{
-			ignoreblankline_ = false;
-			return token_comment;
-		}
-		break;
-	case 'u':
-		if (!std::strcmp(str, "unset"))		return token_unset;
-		else if (!strcmp(str, "using"))		return token_using;
-		break;
-	case 'w':
-		if (!std::strcmp(str, "while"))		return token_while;
+	case pragma_noignoreindent:
+		ignoreindent_ = false;
 		break;
 	default:
 		break;
 	}
-	return token_usermacro;
+	return r.type;
 }
 
 
@@ -893,22 +1057,37 @@ void Lex::buildnumber(std::string& value)
  */
 void Lex::buildrawtext(std::string& value)
 {
-	while (char c = safeget())
+	// Scan the buffered text in bulk rather than one safeget() at a time.
+	unsigned long avail;
+	const char* text;
+	while (text = buf_.peek(avail), avail)
 	{
-		switch (c) {
-		case '$':
-		case '@':
-		case '\\':
-		case '{':
-		case '}':
-		case '\r':
-		case '\n':
-		case ' ':
-		case '\t':
-			safeunget();
+		unsigned long len = textspan(text, avail);
+		// Spaces between words stay in the text, since they would be
+		// output unchanged as a whitespace token.
+		while ((len < avail) && ((text[len] == ' ') || (text[len] == '\t')))
+		{
+			unsigned long next = len + 1;
+			while ((next < avail) && ((text[next] == ' ') ||
+					(text[next] == '\t')))
+				++next;
+			if ((next == avail) || istextend(text[next]) ||
+					std::isspace(static_cast<unsigned char>(text[next])))
+				break;
+			len = next + textspan(text + next, avail - next);
+		}
+		value.append(text, len);
+		column_+= len;
+		buf_.skip(len);
+		if (len < avail)
+		{
+			// A nul ends the text and is dropped.
+			if (!text[len])
+			{
+				++column_;
+				buf_.skip(1);
+			}
 			return;
-		default:
-			value+= c;
 		}
 	}
 }
@@ -48,14 +48,36 @@ public:
 	Lex(Buffer& b) : buf_(b), lineno_(1), column_(1), ignoreindent_(false),
 		ignoreblankline_(false) {}
 
+	// Position and flags, used to skip over code that was compiled
+	struct State {
+		unsigned long index;
+		unsigned lineno;
+		unsigned column;
+		bool ignoreindent;
+		bool ignoreblankline;
+
+		bool operator==(const State& s) const
+		{
+			return (index == s.index) && (lineno == s.lineno) &&
+				(column == s.column) && (ignoreindent == s.ignoreindent) &&
+				(ignoreblankline == s.ignoreblankline);
+		}
+	};
+	void getstate(State& s) const;
+	void setstate(const State& s);
+
 	Token<> getloosetoken();
 	Token<> getstricttoken();
 	Token<> getspecialtoken();
+	void getloosetoken(Token<>& t);
+	void getstricttoken(Token<>& t);
+	void getspecialtoken(Token<>& t);
 	void unget(const Token<>& tok);
 	unsigned getlineno() const;
 	void setlineno(unsigned newline);
 	unsigned long index() const;
 	bool seek(unsigned long index);
+	void discard();
 
 	///! Extract an unparsed brace enclosed {} block
 	bool getblock(std::string& block, unsigned& lineno);
@@ -69,7 +91,7 @@ public:
 	{ if (!buf_) return 0; ++column_; return buf_.getnextchar(); }
 	void safeunget()
 	{ --column_; buf_.unget(); }
-	Token<>::en checkreserved(const char* str);
+	Token<>::en checkreserved(const char* str, unsigned len);
 	void buildidentifier(std::string& value);
 	void buildnumber(std::string& value);
 	void buildrawtext(std::string& value);
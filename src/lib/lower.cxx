@@ -0,0 +1,524 @@
+/*
+ * lower.cxx
+ *
+ * Lower a compiled node tree to bytecode
+ *
+ * Copyright (C) 2010 Isaac W. Foraker (isaac at noscience dot net)
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Author nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "conf.h"
+#include "compile.h"
+#include "parse_impl.h"
+#include <map>
+#include <utility>
+
+namespace TPT {
+
+namespace {
+
+// Instructions whose jump target is filled in once it is known
+typedef std::vector< std::pair< unsigned, unsigned Instr::* > > PatchList;
+
+// Where an expression goes when it fails
+struct FailTarget {
+	PatchList patches;
+	unsigned depth;		// stack depth to restore
+};
+
+// Where @next and @last go
+struct LoopTarget {
+	unsigned cont;
+	PatchList breaks;
+};
+
+class Lowering {
+public:
+	Program& prog;
+	std::map< std::string, unsigned > stringmap;
+	std::map< std::string, unsigned > pathmap;
+	unsigned depth;		// stack depth at the current instruction
+	unsigned line;		// source line of the current node
+
+	Lowering(Program& p) : prog(p), depth(0), line(1) {}
+
+	unsigned emit(unsigned op, unsigned a=0, unsigned b=0, unsigned c=0);
+	unsigned here() const { return prog.code.size(); }
+	void patch(PatchList& patches, unsigned target);
+	unsigned intern(const std::string& str);
+	unsigned internpath(const std::string& id);
+	unsigned addtoken(const Token<>& tok);
+
+	void lowerblock(const NodeList& nodes, LoopTarget* loop, bool toplevel);
+	void lowernode(const Node& node);
+	void lowerif(const Node& node);
+	void lowerwhile(const Node& node);
+	void lowerforeach(const Node& node);
+	unsigned lowerparams(const ExprList& exprs, FailTarget& fail);
+	void lowerexpr(const Expr& expr, FailTarget& fail);
+};
+
+
+unsigned Lowering::emit(unsigned op, unsigned a, unsigned b, unsigned c)
+{
+	Instr ins;
+	ins.op = op;
+	ins.a = a;
+	ins.b = b;
+	ins.c = c;
+	ins.line = line;
+	prog.code.push_back(ins);
+	return prog.code.size() - 1;
+}
+
+
+void Lowering::patch(PatchList& patches, unsigned target)
+{
+	PatchList::const_iterator it(patches.begin()), end(patches.end());
+	for (; it != end; ++it)
+		prog.code[it->first].*(it->second) = target;
+	patches.clear();
+}
+
+
+unsigned Lowering::intern(const std::string& str)
+{
+	std::map< std::string, unsigned >::const_iterator it(stringmap.find(str));
+	if (it != stringmap.end())
+		return it->second;
+	unsigned index = prog.strings.size();
+	prog.strings.push_back(str);
+	stringmap[str] = index;
+	return index;
+}
+
+
+unsigned Lowering::internpath(const std::string& id)
+{
+	std::map< std::string, unsigned >::const_iterator it(pathmap.find(id));
+	if (it != pathmap.end())
+		return it->second;
+	unsigned index = prog.paths.size();
+	prog.paths.push_back(SymbolPath());
+	Symbols_Impl::parsepath(id, prog.paths.back());
+	pathmap[id] = index;
+	return index;
+}
+
+
+unsigned Lowering::addtoken(const Token<>& tok)
+{
+	prog.tokens.push_back(tok);
+	return prog.tokens.size() - 1;
+}
+
+
+/*
+ * Lower a block.  At the top level of a loop body @next and @last jump
+ * straight to the loop; in a sub-block they set a flag that is checked
+ * once the enclosing top level statement is done.
+ *
+ */
+void Lowering::lowerblock(const NodeList& nodes, LoopTarget* loop,
+	bool toplevel)
+{
+	NodeList::const_iterator it(nodes.begin()), end(nodes.end());
+	for (; it != end; ++it)
+	{
+		const Node& node = **it;
+		line = node.lineno;
+		if ((node.type == Node::node_next) || (node.type == Node::node_last))
+		{
+			if (toplevel && loop)
+			{
+				if (node.type == Node::node_next)
+					emit(op_jump, loop->cont);
+				else
+					loop->breaks.push_back(std::make_pair(emit(op_jump),
+						&Instr::a));
+			}
+			else
+				emit(op_loop_cmd, (node.type == Node::node_next) ? loop_next :
+					loop_last);
+			continue;
+		}
+		lowernode(node);
+		if (toplevel && loop && (node.type == Node::node_if))
+		{
+			bool nested = false;
+			std::vector< NodeList >::const_iterator bit(node.blocks.begin()),
+				bend(node.blocks.end());
+			for (; !nested && bit != bend; ++bit)
+				nested = hasloopcmd(*bit);
+			if (nested)
+				loop->breaks.push_back(std::make_pair(
+					emit(op_check, loop->cont), &Instr::b));
+		}
+	}
+}
+
+
+void Lowering::lowernode(const Node& node)
+{
+	line = node.lineno;
+	switch (node.type)
+	{
+	case Node::node_text:
+		if (!node.value.empty())
+		{
+			emit(op_emit_text, prog.text.size(), node.value.size());
+			prog.text+= node.value;
+		}
+		break;
+	case Node::node_symbol:
+		emit(op_emit_sym, intern(node.value), internpath(node.value));
+		break;
+	case Node::node_if:
+		lowerif(node);
+		break;
+	case Node::node_while:
+		lowerwhile(node);
+		break;
+	case Node::node_foreach:
+		lowerforeach(node);
+		break;
+	case Node::node_pop:
+		prog.idlists.push_back(node.ids);
+		emit(op_pop, prog.idlists.size() - 1);
+		break;
+	case Node::node_macro:
+		{
+			Macro newmacro;
+			newmacro.params = node.ids;
+			newmacro.lineno = node.lineno;
+			newmacro.code = node.code;
+			prog.macros.push_back(newmacro);
+			emit(op_macro, intern(node.value), prog.macros.size() - 1);
+		}
+		break;
+	case Node::node_next:
+	case Node::node_last:
+		// Handled by lowerblock()
+		break;
+	default:
+		{
+			FailTarget fail;
+			fail.depth = depth;
+			unsigned argc = lowerparams(node.params, fail);
+			unsigned op, a = 0;
+			switch (node.type)
+			{
+			case Node::node_set:
+				op = op_set;
+				a = intern(node.value);
+				break;
+			case Node::node_setif:
+				op = op_setif;
+				a = intern(node.value);
+				break;
+			case Node::node_unset:
+				op = op_unset;
+				a = intern(node.value);
+				break;
+			case Node::node_keys:
+				op = op_keys;
+				a = intern(node.value);
+				break;
+			case Node::node_push:
+				op = op_push;
+				a = intern(node.value);
+				break;
+			case Node::node_include:
+				op = op_include;
+				break;
+			case Node::node_includetext:
+				op = op_includetext;
+				break;
+			case Node::node_using:
+				op = op_using;
+				break;
+			case Node::node_builtin:
+				op = op_builtin_emit;
+				a = node.builtin;
+				break;
+			default:
+				op = op_call_emit;
+				a = intern(node.value);
+				break;
+			}
+			line = node.lineno;
+			emit(op, a, argc);
+			depth-= argc;
+			patch(fail.patches, here());
+		}
+		break;
+	}
+}
+
+
+void Lowering::lowerif(const Node& node)
+{
+	FailTarget fail;
+	fail.depth = depth;
+	PatchList ends;
+	bool haselse = node.blocks.size() > node.conds.size();
+	size_t i;
+
+	for (i = 0; i < node.conds.size(); ++i)
+	{
+		unsigned argc = lowerparams(node.conds[i], fail);
+		line = node.lineno;
+		unsigned test = emit(op_jump_if_false, 0, 0, argc);
+		depth-= argc;
+		fail.patches.push_back(std::make_pair(test, &Instr::b));
+		lowerblock(node.blocks[i], 0, false);
+		if (haselse || (i+1 < node.conds.size()))
+			ends.push_back(std::make_pair(emit(op_jump), &Instr::a));
+		prog.code[test].a = here();
+	}
+	if (haselse)
+		lowerblock(node.blocks.back(), 0, false);
+	patch(ends, here());
+	patch(fail.patches, here());
+}
+
+
+void Lowering::lowerwhile(const Node& node)
+{
+	LoopTarget loop;
+	loop.cont = here();
+	FailTarget fail;
+	fail.depth = depth;
+
+	unsigned argc = lowerparams(node.params, fail);
+	line = node.lineno;
+	unsigned test = emit(op_jump_if_false, 0, 0, argc);
+	depth-= argc;
+	fail.patches.push_back(std::make_pair(test, &Instr::b));
+	loop.breaks.push_back(std::make_pair(test, &Instr::a));
+
+	lowerblock(node.blocks[0], &loop, true);
+	emit(op_jump, loop.cont);
+	patch(loop.breaks, here());
+	patch(fail.patches, here());
+}
+
+
+void Lowering::lowerforeach(const Node& node)
+{
+	FailTarget fail;
+	fail.depth = depth;
+
+	unsigned argc = lowerparams(node.params, fail);
+	line = node.lineno;
+	unsigned start = emit(op_foreach, intern(node.value), 0, argc);
+	depth-= argc;
+
+	LoopTarget loop;
+	loop.cont = emit(op_iter_next);
+	loop.breaks.push_back(std::make_pair(loop.cont, &Instr::a));
+	lowerblock(node.blocks[0], &loop, true);
+	emit(op_jump, loop.cont);
+	patch(loop.breaks, emit(op_iter_pop));
+
+	prog.code[start].b = here();
+	patch(fail.patches, here());
+}
+
+
+unsigned Lowering::lowerparams(const ExprList& exprs, FailTarget& fail)
+{
+	ExprList::const_iterator it(exprs.begin()), end(exprs.end());
+	for (; it != end; ++it)
+		lowerexpr(**it, fail);
+	return exprs.size();
+}
+
+
+void Lowering::lowerexpr(const Expr& expr, FailTarget& fail)
+{
+	switch (expr.type)
+	{
+	case Expr::expr_literal:
+		emit(op_push_str, intern(expr.tok.value));
+		++depth;
+		break;
+	case Expr::expr_symbol:
+		emit(op_load_sym, intern(expr.tok.value),
+			internpath(expr.tok.value));
+		++depth;
+		break;
+	case Expr::expr_token:
+		emit(op_push_token, addtoken(expr.tok));
+		++depth;
+		break;
+	case Expr::expr_unary:
+		{
+			lowerexpr(*expr.args[0], fail);
+			unsigned op;
+			if (expr.tok.op == oper_not)
+				op = op_not;
+			else if (expr.tok.op == oper_sub)
+				op = op_neg;
+			else
+				op = op_plus;
+			fail.patches.push_back(std::make_pair(
+				emit(op, addtoken(expr.tok), 0, fail.depth), &Instr::b));
+		}
+		break;
+	case Expr::expr_binary:
+		if ((expr.tok.op == oper_and) || (expr.tok.op == oper_or))
+		{
+			// Jump over the right side when the left side decides
+			lowerexpr(*expr.args[0], fail);
+			fail.patches.push_back(std::make_pair(
+				emit(op_scalar, addtoken(expr.tok), 0, fail.depth), &Instr::b));
+			unsigned test = emit((expr.tok.op == oper_and) ? op_and_jump :
+				op_or_jump);
+			--depth;
+			lowerexpr(*expr.args[1], fail);
+			emit(op_truth);
+			prog.code[test].a = here();
+		}
+		else
+		{
+			lowerexpr(*expr.args[0], fail);
+			lowerexpr(*expr.args[1], fail);
+			unsigned op;
+			switch (expr.tok.op)
+			{
+			case oper_xor:
+				op = op_xor;
+				break;
+			case oper_eq:
+				op = op_eq;
+				break;
+			case oper_ne:
+				op = op_ne;
+				break;
+			case oper_lt:
+				op = op_lt;
+				break;
+			case oper_gt:
+				op = op_gt;
+				break;
+			case oper_le:
+				op = op_le;
+				break;
+			case oper_ge:
+				op = op_ge;
+				break;
+			case oper_add:
+				op = op_add;
+				break;
+			case oper_sub:
+				op = op_sub;
+				break;
+			case oper_mul:
+				op = op_mul;
+				break;
+			case oper_div:
+				op = op_div;
+				break;
+			case oper_mod:
+				op = op_mod;
+				break;
+			default:
+				op = op_relop;
+				break;
+			}
+			fail.patches.push_back(std::make_pair(
+				emit(op, addtoken(expr.tok), 0, fail.depth), &Instr::b));
+			--depth;
+		}
+		break;
+	case Expr::expr_call:
+	case Expr::expr_builtin:
+		{
+			// A call whose parameters fail evaluates to an empty string
+			FailTarget argfail;
+			argfail.depth = depth;
+			unsigned argc = lowerparams(expr.args, argfail);
+			if (expr.type == Expr::expr_call)
+				emit(op_call_func, intern(expr.tok.value), argc);
+			else
+				emit(op_builtin, expr.tok.type, argc);
+			depth-= argc;
+			++depth;
+			if (!argfail.patches.empty())
+			{
+				unsigned skip = emit(op_jump);
+				patch(argfail.patches, emit(op_push_str, intern("")));
+				prog.code[skip].a = here();
+			}
+		}
+		break;
+	}
+}
+
+} // end anonymous namespace
+
+
+/*
+ * Check whether a sub-block contains a nested @next or @last.
+ *
+ */
+bool hasloopcmd(const NodeList& nodes)
+{
+	NodeList::const_iterator it(nodes.begin()), end(nodes.end());
+	for (; it != end; ++it)
+	{
+		const Node& node = **it;
+		if ((node.type == Node::node_next) || (node.type == Node::node_last))
+			return true;
+		if (node.type == Node::node_if)
+		{
+			std::vector< NodeList >::const_iterator bit(node.blocks.begin()),
+				bend(node.blocks.end());
+			for (; bit != bend; ++bit)
+				if (hasloopcmd(*bit))
+					return true;
+		}
+	}
+	return false;
+}
+
+
+
+/*
+ * Lower a compiled node tree to a Program.
+ *
+ */
+void lowertemplate(const NodeList& nodes, Program& prog)
+{
+	Lowering lowering(prog);
+	lowering.lowerblock(nodes, 0, false);
+}
+
+} // end namespace TPT
@@ -34,6 +34,7 @@
 #ifndef include_libtpt_macro_h
 #define include_libtpt_macro_h
 
+#include <libtpt/template.h>
 #include <map>
 #include <string>
 #include <vector>
@@ -46,7 +47,7 @@ typedef std::vector< std::string > ParamList;
 struct Macro {
 	ParamList params;
 	unsigned lineno;
-	std::string body;
+	Template code;	// compiled body
 };
 
 typedef std::map< std::string, bool (*)(std::ostream&, Object&) > FunctionList;
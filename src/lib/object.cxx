@@ -33,11 +33,24 @@
 
 #include "conf.h"
 #include <libtpt/object.h>
+#include "funcs.h"
+#include "threads.h"
+#include "arena.h"
 
 #include <iostream>
+#include <new>
+#include <cstdio>
+#include <cstdlib>
 
 namespace TPT {
 
+namespace {
+
+// Names the std::string destructor for the string kept in an Object
+typedef std::string string_type;
+
+} // end anonymous namespace
+
 /*
  * Note: Only set "type" AFTER calling "new" to allocate memory since
  * new might throw an exception.
@@ -50,7 +63,7 @@ namespace TPT {
  * @param   t       The type of object to be set
  */
 Object::Object(obj_types t) throw(tptexception)
-    : type(type_notalloc)
+    : refcount(0), type(type_notalloc)
 {
     create(t);
 }
@@ -62,7 +75,7 @@ Object::Object(obj_types t) throw(tptexception)
  * @param   obj     The type of object to be set
  */
 Object::Object(const Object& obj) throw(tptexception)
-    : type(type_notalloc)
+    : refcount(0), type(type_notalloc)
 {
     createcopy(obj);
 }
@@ -75,9 +88,10 @@ Object::Object(const Object& obj) throw(tptexception)
  * @return  nothing
  */
 Object::Object(const std::string& s)
-    : type(type_notalloc)
+    : refcount(0), type(type_notalloc)
 {
-    u.str = new std::string(s);
+    new (u.str) std::string(s);
+    scalartype = scalar_string;
     type = type_scalar;
 }
 
@@ -89,9 +103,10 @@ Object::Object(const std::string& s)
  * @return  nothing
  */
 Object::Object(const char* str)
-    : type(type_notalloc)
+    : refcount(0), type(type_notalloc)
 {
-    u.str = new std::string(str);
+    new (u.str) std::string(str);
+    scalartype = scalar_string;
     type = type_scalar;
 }
 
@@ -103,7 +118,7 @@ Object::Object(const char* str)
  * @return  nothing
  */
 Object::Object(const ArrayType& a)
-    : type(type_notalloc)
+    : refcount(0), type(type_notalloc)
 {
     u.array = new ArrayType(a);
     type = type_array;
@@ -117,7 +132,7 @@ Object::Object(const ArrayType& a)
  * @return  nothing
  */
 Object::Object(const HashType& h)
-    : type(type_notalloc)
+    : refcount(0), type(type_notalloc)
 {
     u.hash = new HashType(h);
     type = type_hash;
@@ -131,7 +146,7 @@ Object::Object(const HashType& h)
  * @return  nothing
  */
 Object::Object(const TokenType& tok)
-    : type(type_notalloc)
+    : refcount(0), type(type_notalloc)
 {
     u.token = new TokenType(tok);
     type = type_token;
@@ -145,7 +160,7 @@ Object::Object(const TokenType& tok)
  * @return  nothing
  */
 Object::Object(const TArrayType& v)
-    : type(type_notalloc)
+    : refcount(0), type(type_notalloc)
 {
     u.array = new ArrayType;
     type = type_array;
@@ -167,7 +182,7 @@ Object::Object(const TArrayType& v)
  * @return  nothing
  */
 Object::Object(const THashType& h)
-    : type(type_notalloc)
+    : refcount(0), type(type_notalloc)
 {
     u.hash = new HashType;
     type = type_hash;
@@ -186,12 +201,13 @@ Object::Object(const THashType& h)
  */
 Object& Object::operator=(const std::string& s)
 {
-    if (type == type_scalar)
-        *u.str = s;
+    if ((type == type_scalar) && (scalartype == scalar_string))
+        str() = s;
     else
     {
         deallocate();
-        u.str = new std::string(s);
+        new (u.str) std::string(s);
+        scalartype = scalar_string;
         type = type_scalar;
     }
     return *this;
@@ -206,12 +222,13 @@ Object& Object::operator=(const std::string& s)
  */
 Object& Object::operator=(const char* s)
 {
-    if (type == type_scalar)
-        *u.str = s;
+    if ((type == type_scalar) && (scalartype == scalar_string))
+        str() = s;
     else
     {
         deallocate();
-        u.str = new std::string(s);
+        new (u.str) std::string(s);
+        scalartype = scalar_string;
         type = type_scalar;
     }
     return *this;
@@ -356,7 +373,8 @@ Object& Object::operator=(const THashType& h)
 void Object::deallocate() {
     switch(type) {
     case type_scalar:
-        delete u.str;
+        if (scalartype == scalar_string)
+            str().~string_type();
         break;
     case type_array:
         delete u.array;
@@ -387,7 +405,10 @@ void Object::settype(obj_types t) throw(tptexception)
 }
 
 /**
- * Get this object's string
+ * Get this object's string.  A numeric scalar is replaced by its string
+ * form, and any other object by an empty scalar, so this changes the
+ * object; read objects that other threads may also read with
+ * scalar(std::string&) instead.
  *
  * @return  Reference to this object's string.
  * @exception  tptexception
@@ -396,7 +417,130 @@ std::string& Object::scalar() throw(tptexception)
 {
     if (type != type_scalar)
         settype(type_scalar);
-    return *u.str;
+    else if (scalartype != scalar_string)
+        makestring();
+    return str();
+}
+
+/**
+ * Read this object's string without changing the object.  The string of
+ * a numeric scalar is built in buf, and an object that is not a scalar
+ * reads as an empty string.
+ *
+ * @param   buf         Space for a string that must be built.
+ * @return  Reference to this object's string, or to buf.
+ */
+const std::string& Object::scalar(std::string& buf) const
+{
+    if (type != type_scalar)
+        buf.erase();
+    else if (scalartype == scalar_string)
+        return str();
+    else
+        numbertostring(buf);
+    return buf;
+}
+
+/**
+ * Get this object's value as an integer.  A string scalar is converted
+ * each time it is read; use setinteger() to keep a result in binary.
+ *
+ * @return  Integer value of this scalar.
+ * @exception  tptexception
+ */
+TIntegerType Object::integer() throw(tptexception)
+{
+    if (type != type_scalar)
+    {
+        settype(type_scalar);
+        return 0;
+    }
+    switch (scalartype) {
+    case scalar_integer:
+        return u.integer;
+    case scalar_real:
+        return static_cast<TIntegerType>(u.real);
+    default:
+        return str2num(str().c_str());
+    }
+}
+
+/**
+ * Get this object's value as a floating point number.
+ *
+ * @return  Floating point value of this scalar.
+ * @exception  tptexception
+ */
+double Object::real() throw(tptexception)
+{
+    if (type != type_scalar)
+    {
+        settype(type_scalar);
+        return 0;
+    }
+    switch (scalartype) {
+    case scalar_integer:
+        return static_cast<double>(u.integer);
+    case scalar_real:
+        return u.real;
+    default:
+        return std::strtod(str().c_str(), 0);
+    }
+}
+
+/**
+ * Make this object an integer scalar.  The string form is not built until
+ * scalar() is called.
+ *
+ * @param   n           New value.
+ */
+void Object::setinteger(TIntegerType n)
+{
+    deallocate();
+    u.integer = n;
+    scalartype = scalar_integer;
+    type = type_scalar;
+}
+
+/**
+ * Make this object a floating point scalar.  The string form is not built
+ * until scalar() is called.
+ *
+ * @param   d           New value.
+ */
+void Object::setreal(double d)
+{
+    deallocate();
+    u.real = d;
+    scalartype = scalar_real;
+    type = type_scalar;
+}
+
+/**
+ * Replace a numeric scalar with its string form.
+ */
+void Object::makestring()
+{
+    std::string text;
+    numbertostring(text);
+    new (u.str) std::string;
+    str().swap(text);
+    scalartype = scalar_string;
+}
+
+/**
+ * Write the string form of a numeric scalar to out.
+ */
+void Object::numbertostring(std::string& out) const
+{
+    if (scalartype == scalar_integer)
+        num2str(u.integer, out);
+    else
+    {
+        char buf[32];
+        std::sprintf(buf, "%.15g", u.real);
+        out = buf;
+    }
 }
 
 /**
@@ -528,7 +672,8 @@ void Object::create(obj_types t) throw(tptexception)
 {
     switch (t) {
     case type_scalar:
-        u.str = new std::string;
+        new (u.str) std::string;
+        scalartype = scalar_string;
         break;
     case type_array:
         u.array = new ArrayType;
@@ -554,7 +699,11 @@ void Object::createcopy(const Object& obj) throw(tptexception)
 {
     switch (obj.type) {
     case type_scalar:
-        u.str = new std::string(*obj.u.str);
+        if (obj.scalartype == scalar_string)
+            new (u.str) std::string(obj.str());
+        else
+            u = obj.u;
+        scalartype = obj.scalartype;
         break;
     case type_array:
         u.array = new ArrayType(*obj.u.array);
@@ -573,4 +722,50 @@ void Object::createcopy(const Object& obj) throw(tptexception)
     type = obj.type;
 }
 
+
+/**
+ * Allocate memory for an Object.
+ *
+ * @param   size    Size of the object
+ * @return  The memory
+ */
+void* Object::operator new(std::size_t size)
+{
+    return ObjectArena::allocate(size);
+}
+
+
+/**
+ * Free memory allocated for an Object.
+ *
+ * @param   p       The memory
+ */
+void Object::operator delete(void* p)
+{
+    ObjectArena::deallocate(p);
+}
+
+
+/**
+ * Atomically count a new PtrType to an object.
+ *
+ * @param   obj     The object
+ */
+void Object::atomicaddref(const Object* obj)
+{
+    atomicincrement(obj->refcount);
+}
+
+
+/**
+ * Atomically count a PtrType released from an object.
+ *
+ * @param   obj     The object
+ * @return  The number of PtrTypes left
+ */
+long Object::atomicrelease(const Object* obj)
+{
+    return atomicdecrement(obj->refcount);
+}
+
 } // end namespace TPT
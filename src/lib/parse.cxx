@@ -113,6 +113,29 @@ Parser::Parser(Buffer& buf, const Symbols& st)
     imp->symbols.copy(st);
 }
 
+/**
+ * Construct a Parser for a compiled Template.  Running the Parser
+ * renders the Template without lexing the template source again.
+ *
+ * @param   t           Reference to compiled Template.
+ */
+Parser::Parser(const Template& t)
+{
+    imp = new Parser_Impl(t);
+}
+
+/**
+ * Construct a Parser for a compiled Template and Symbols table.
+ *
+ * @param   t           Reference to compiled Template.
+ * @param   st          Reference to Symbols table.
+ */
+Parser::Parser(const Template& t, const Symbols& st)
+{
+    imp = new Parser_Impl(t);
+    imp->symbols.copy(st);
+}
+
 /**
  * Destruct this Parser.
  */
@@ -204,6 +227,21 @@ bool Parser::geterrorlist(ErrorList& errlist)
 void Parser::addincludepath(const char* path)
 {
     imp->inclist.push_back(path);
+    imp->includes.clear();
+}
+
+
+/**
+ * Share compiled include files through a TemplateCache, so that files
+ * included by many parsers are read and compiled once.  By default,
+ * each parser compiles the files it includes.
+ *
+ * @param   cache   Cache to use for included files.
+ * @return  nothing
+ */
+void Parser::setincludecache(TemplateCache& cache)
+{
+    imp->inccache = &cache;
 }
 
 
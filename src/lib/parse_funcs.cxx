@@ -98,10 +98,20 @@ unsigned int Parser_Impl::random32()
 Token<> Parser_Impl::parse_rand()
 {
 	Object params;
-	Token<> result;
-	result.type = token_integer;
 	if (getparamlist(params))
+	{
+		Token<> result;
+		result.type = token_integer;
 		return result;
+	}
+	return do_rand(params);
+}
+
+
+Token<> Parser_Impl::do_rand(Object& params)
+{
+	Token<> result;
+	result.type = token_integer;
 	int64_t lwork = 0xFFFFFFFF;
 	Object::ArrayType& pl = params.array();
 
@@ -111,7 +121,7 @@ Token<> Parser_Impl::parse_rand()
 		if (obj.gettype() != Object::type_scalar)
 			recorderror("Error: Expected scalar expression");
 		else
-			lwork = str2num(obj.scalar().c_str());
+			lwork = obj.integer();
 		if (pl.size() > 1)
 			recorderror("Warning: @rand takes zero or one arguments");
 	}
@@ -133,10 +143,20 @@ Token<> Parser_Impl::parse_rand()
 Token<> Parser_Impl::parse_empty()
 {
 	Object params;
-	Token<> result;
-	result.type = token_integer;
 	if (getparamlist(params))
+	{
+		Token<> result;
+		result.type = token_integer;
 		return result;
+	}
+	return do_empty(params);
+}
+
+
+Token<> Parser_Impl::do_empty(Object& params)
+{
+	Token<> result;
+	result.type = token_integer;
 	Object::ArrayType& pl = params.array();
 
 	if (pl.empty())
@@ -164,10 +184,20 @@ Token<> Parser_Impl::parse_empty()
 Token<> Parser_Impl::parse_size()
 {
 	Object params;
-	Token<> result;
-	result.type = token_integer;
 	if (getparamlist(params))
+	{
+		Token<> result;
+		result.type = token_integer;
 		return result;
+	}
+	return do_size(params);
+}
+
+
+Token<> Parser_Impl::do_size(Object& params)
+{
+	Token<> result;
+	result.type = token_integer;
 	Object::ArrayType& pl = params.array();
 	size_t size=0;
 
@@ -195,10 +225,20 @@ Token<> Parser_Impl::parse_size()
 Token<> Parser_Impl::parse_compare()
 {
 	Object params;
-	Token<> result;
-	result.type = token_integer;
 	if (getparamlist(params))
+	{
+		Token<> result;
+		result.type = token_integer;
 		return result;
+	}
+	return do_compare(params);
+}
+
+
+Token<> Parser_Impl::do_compare(Object& params)
+{
+	Token<> result;
+	result.type = token_integer;
 	Object::ArrayType& pl = params.array();
 
 	if (pl.size() < 2)
@@ -230,10 +270,20 @@ Token<> Parser_Impl::parse_compare()
 Token<> Parser_Impl::parse_isarray()
 {
 	Object params;
-	Token<> result;
-	result.type = token_integer;
 	if (getparamlist(params))
+	{
+		Token<> result;
+		result.type = token_integer;
 		return result;
+	}
+	return do_isarray(params);
+}
+
+
+Token<> Parser_Impl::do_isarray(Object& params)
+{
+	Token<> result;
+	result.type = token_integer;
 	Object::ArrayType& pl = params.array();
 
 	if (pl.empty())
@@ -255,10 +305,20 @@ Token<> Parser_Impl::parse_isarray()
 Token<> Parser_Impl::parse_ishash()
 {
 	Object params;
-	Token<> result;
-	result.type = token_integer;
 	if (getparamlist(params))
+	{
+		Token<> result;
+		result.type = token_integer;
 		return result;
+	}
+	return do_ishash(params);
+}
+
+
+Token<> Parser_Impl::do_ishash(Object& params)
+{
+	Token<> result;
+	result.type = token_integer;
 	Object::ArrayType& pl = params.array();
 
 	if (pl.empty())
@@ -280,10 +340,20 @@ Token<> Parser_Impl::parse_ishash()
 Token<> Parser_Impl::parse_isscalar()
 {
 	Object params;
-	Token<> result;
-	result.type = token_integer;
 	if (getparamlist(params))
+	{
+		Token<> result;
+		result.type = token_integer;
 		return result;
+	}
+	return do_isscalar(params);
+}
+
+
+Token<> Parser_Impl::do_isscalar(Object& params)
+{
+	Token<> result;
+	result.type = token_integer;
 	Object::ArrayType& pl = params.array();
 
 	if (pl.empty())
@@ -36,6 +36,7 @@
 #include "conf.h"
 #include "parse_impl.h"
 #include "funcs.h"
+#include "arena.h"
 #include <algorithm>
 #include <sstream>
 #include <iostream>
@@ -64,7 +65,12 @@ void Parser_Impl::installfuncs()
 
 bool Parser_Impl::pass1(std::ostream* os)
 {
-	parse_main(os);
+	// Objects made by this run come from one arena
+	ObjectArena::scope arena;
+	if (!code.empty())
+		render_main(os);
+	else
+		parse_main(os);
 
 	return !errlist.empty();
 }
@@ -82,7 +88,13 @@ void Parser_Impl::parse_main(std::ostream* os)
 			parse_dotoken(os, tok);
 			break;
 		}
-		tok = lex.getloosetoken();
+		// Top level text already parsed is never revisited, nor are
+		// the loops compiled from it.
+		lex.discard();
+		if (!loopsites.empty())
+			loopsites.erase(loopsites.begin(),
+				loopsites.lower_bound(lex.index()));
+		lex.getloosetoken(tok);
 	}
 }
 
@@ -111,46 +123,8 @@ void Parser_Impl::parse_block(std::ostream* os)
 
 	do {
 		// Read a loosely defined token for outer pass
-		tok = lex.getloosetoken();
-		switch (tok.type) {
-		// Close brace (}) is end of block
-		case token_closebrace:
-			break;
-		case token_eof:
-			recorderror("Unexpected end of file");
-			break;
-		default:
-			parse_dotoken(os, tok);
-			break;
-		}
-	} while ( (tok.type != token_eof) && (tok.type != token_closebrace) );
-}
-
-
-/*
- * Add special handling to a loop block to support @next and @last
- * calls.
- *
- * @return	true on end of block or @next;
- * @return	false on @last
- *
- */
-bool Parser_Impl::parse_loopblock(std::ostream* os)
-{
-	cntguard<unsigned> gc(level), glc(looplevel);
-	loop_cmd = loop_ign;
-	Token<> tok(lex.getstricttoken());
-	if (tok.type != token_openbrace)
-		recorderror("Expected open brace '{'", &tok);
-
-	do {
-		// Read a loosely defined token for outer pass
-		tok = lex.getloosetoken();
+		lex.getloosetoken(tok);
 		switch (tok.type) {
-		case token_next:
-			return true;
-		case token_last:
-			return false;
 		// Close brace (}) is end of block
 		case token_closebrace:
 			break;
@@ -161,18 +135,7 @@ bool Parser_Impl::parse_loopblock(std::ostream* os)
 			parse_dotoken(os, tok);
 			break;
 		}
-		if (loop_cmd == loop_next)
-		{
-			loop_cmd = loop_ign;
-			return true;
-		}
-		if (loop_cmd == loop_last)
-		{
-			loop_cmd = loop_ign;
-			return false;
-		}
 	} while ( (tok.type != token_eof) && (tok.type != token_closebrace) );
-	return true;
 }
 
 
@@ -180,8 +143,9 @@ bool Parser_Impl::parse_loopblock(std::ostream* os)
  * Handle any tokens not handled by the calling function
  *
  */
-void Parser_Impl::parse_dotoken(std::ostream* os, Token<> tok)
+void Parser_Impl::parse_dotoken(std::ostream* os, const Token<>& tok)
 {
+	Token<> result;
 	switch (tok.type)
 	{
 	// Quit on end of file.
@@ -255,38 +219,38 @@ void Parser_Impl::parse_dotoken(std::ostream* os, Token<> tok)
 		break;
 	// Display a random number.
 	case token_rand:
-		tok = parse_rand();
-		if (os) *os << tok.value;
+		result = parse_rand();
+		if (os) *os << result.value;
 		break;
 	// Check if a variable is empty, but why would this be raw.
 	case token_empty:
-		tok = parse_empty();
-		if (os) *os << tok.value;
+		result = parse_empty();
+		if (os) *os << result.value;
 		break;
 	// Get size of array variable
 	case token_size:
-		tok = parse_size();
-		if (os) *os << tok.value;
+		result = parse_size();
+		if (os) *os << result.value;
 		break;
 	// Compare two strings
 	case token_compare:
-		tok = parse_compare();
-		if (os) *os << tok.value;
+		result = parse_compare();
+		if (os) *os << result.value;
 		break;
 	// Check if symbol is array
 	case token_isarray:
-		tok = parse_isarray();
-		if (os) *os << tok.value;
+		result = parse_isarray();
+		if (os) *os << result.value;
 		break;
 	// Check if symbol is hash
 	case token_ishash:
-		tok = parse_ishash();
-		if (os) *os << tok.value;
+		result = parse_ishash();
+		if (os) *os << result.value;
 		break;
 	// Check if symbol is scalar
 	case token_isscalar:
-		tok = parse_isscalar();
-		if (os) *os << tok.value;
+		result = parse_isscalar();
+		if (os) *os << result.value;
 		break;
 	// Call a user defined macro
 	case token_usermacro:
@@ -295,18 +259,7 @@ void Parser_Impl::parse_dotoken(std::ostream* os, Token<> tok)
 		else
 			user_macro(tok.value, os);
 		break;
-	case token_next:
-		if (looplevel > 0)
-			loop_cmd = loop_next;
-		else
-			recorderror("Syntax error", &tok);
-		break;
-	case token_last:
-		if (looplevel > 0)
-			loop_cmd = loop_last;
-		else
-			recorderror("Syntax error", &tok);
-		break;
+	// @next and @last are handled by compiled loops, see parse_loop().
 	// Syntax errors should be hard to create at this point.
 	default:
 		recorderror("Syntax error", &tok);
@@ -323,7 +276,7 @@ void Parser_Impl::parse_dotoken(std::ostream* os, Token<> tok)
  */
 bool Parser_Impl::getnextstrict(Token<>& target)
 {
-	target = lex.getstricttoken();
+	lex.getstricttoken(target);
 	return (target.type == token_eof);
 }
 
@@ -371,19 +324,13 @@ bool Parser_Impl::getparamlist(Object& pl)
 
 	// tok holds the current token and nexttok holds the next token
 	// returned by the rd parser.
-	tok = lex.getstricttoken();
+	lex.getstricttoken(tok);
 	while ((tok.type != token_eof) && (tok.type != token_closeparen))
 	{
-		Object obj(tok);
-		Object nextobj = parse_level0(obj);
-		pl.array().push_back(new Object(obj));
+		Object* obj = new Object;
+		pl.array().push_back(obj);
+		parse_level0(*obj, tok);
 
-		if (nextobj.gettype() != Object::type_token)
-		{
-			recorderror("Syntax error, expected comma or close parenthesis", &tok);
-			return true;
-		}
-		tok = nextobj.token();
 		// The next token should be a comma or a close paren
 		if (tok.type == token_closeparen)
 			break;
@@ -392,7 +339,7 @@ bool Parser_Impl::getparamlist(Object& pl)
 			recorderror("Syntax error, expected comma or close parenthesis", &tok);
 			return true;
 		}
-		tok = lex.getstricttoken();
+		lex.getstricttoken(tok);
 	}
 
 	return false;
@@ -422,29 +369,23 @@ bool Parser_Impl::getidparamlist(std::string& id,  Object& pl)
 
 	// tok holds the current token and nexttok holds the next token
 	// returned by the rd parser.
-	tok = lex.getstricttoken();
+	lex.getstricttoken(tok);
 	if (tok.type != token_id)
 	{
 		recorderror("Syntax error, expected id", &tok);
 		return true;
 	}
 	id = tok.value;
-	tok = lex.getstricttoken();
+	lex.getstricttoken(tok);
 	if (tok.type == token_comma)
-		tok = lex.getstricttoken();
+		lex.getstricttoken(tok);
 
 	while ((tok.type != token_eof) && (tok.type != token_closeparen))
 	{
-		Object obj(tok);
-		Object nextobj = parse_level0(obj);
-		pl.array().push_back(new Object(obj));
+		Object* obj = new Object;
+		pl.array().push_back(obj);
+		parse_level0(*obj, tok);
 
-		if (nextobj.gettype() != Object::type_token)
-		{
-			recorderror("Syntax error, expected comma or close parenthesis", &tok);
-			return true;
-		}
-		tok = nextobj.token();
 		// The next token should be a comma or a close paren
 		if (tok.type == token_closeparen)
 			break;
@@ -453,7 +394,7 @@ bool Parser_Impl::getidparamlist(std::string& id,  Object& pl)
 			recorderror("Syntax error, expected comma or close parenthesis", &tok);
 			return true;
 		}
-		tok = lex.getstricttoken();
+		lex.getstricttoken(tok);
 	}
 
 	return false;
@@ -482,7 +423,7 @@ bool Parser_Impl::getidlist(std::vector< std::string >& ids)
 	}
 
 
-	tok = lex.getstricttoken();
+	lex.getstricttoken(tok);
 	while ((tok.type != token_eof) && (tok.type != token_closeparen))
 	{
 		// tok holds the current token and nexttok holds the next token
@@ -493,7 +434,7 @@ bool Parser_Impl::getidlist(std::vector< std::string >& ids)
 			return true;
 		}
 		ids.push_back(tok.value);
-		tok = lex.getstricttoken();
+		lex.getstricttoken(tok);
 		// The next token should be a comma or a close paren
 		if (tok.type == token_closeparen)
 			break;
@@ -502,7 +443,7 @@ bool Parser_Impl::getidlist(std::vector< std::string >& ids)
 			recorderror("Syntax error, expected comma or close parenthesis", &tok);
 			return true;
 		}
-		tok = lex.getstricttoken();
+		lex.getstricttoken(tok);
 	}
 
 	return false;
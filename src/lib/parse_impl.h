@@ -41,7 +41,10 @@
 #include "conf.h"
 #include "lexical.h"
 #include "macro.h"
+#include "template_impl.h"
 #include <libtpt/parse.h>
+#include <libtpt/template.h>
+#include <libtpt/tcache.h>
 
 namespace TPT {
 
@@ -49,12 +52,31 @@ enum loop_control { loop_ign = 0, loop_next, loop_last };
 
 typedef std::vector< std::string > IncludeList;
 
+// A loop compiled once where the interpreter first reached it
+struct LoopSite {
+	Lex::State entry;	// lexer state before the loop
+	Lex::State exit;	// lexer state after the loop
+	Template code;
+};
+typedef std::map< unsigned long, LoopSite > LoopSiteMap;
+
+// An @include or @includetext target found on the include path
+struct IncludeEntry {
+	std::string path;	// file the name resolved to
+	Template code;		// compiled body, once included
+	std::string text;	// raw body, once included as text
+	bool hastext;
+
+	IncludeEntry() : hastext(false) {}
+};
+typedef std::map< std::string, IncludeEntry > IncludeCache;
+
 class Parser_Impl {
 public:
 	Buffer* allocbuf;
+	Template code;	// compiled template, if rendering one
 	Lex lex;
 	unsigned level;	// block level
-	unsigned looplevel;
 	Symbols localsymmap;
 	Symbols& symbols;	// reference to whatever symbol map is in use
 	MacroList localmacros;
@@ -65,7 +87,12 @@ public:
 	IncludeList localinclist;
 	IncludeList& inclist;
 	bool isseeded;
-	loop_control loop_cmd;
+	TemplateCache* inccache;	// optional shared cache of include bodies
+	unsigned noeval;	// > 0 while skipping the operand of && or ||
+	IncludeCache includes;	// includes resolved by this parser
+	std::vector< Object::PtrType > vmstack;	// bytecode operand stack
+	std::vector< LoopFrame > vmloops;		// running @foreach loops
+	LoopSiteMap loopsites;	// loops compiled by the interpreter
 
 	// kiss_vars are used for pseudo-random number generation
 	unsigned kiss_x;
@@ -78,48 +105,56 @@ public:
 	unsigned kiss_seed;
 
 	Parser_Impl(Buffer& buf) : allocbuf(0), lex(buf), level(0),
-		looplevel(0), symbols(localsymmap), macros(localmacros),
-		funcs(localfuncs), inclist(localinclist), isseeded(false)
+		symbols(localsymmap), macros(localmacros),
+		funcs(localfuncs), inclist(localinclist), isseeded(false), inccache(0), noeval(0)
 	{ installfuncs(); }
 
 	Parser_Impl(Buffer& buf, Symbols& sm) : allocbuf(0), lex(buf),
-		level(0), looplevel(0), symbols(sm),
+		level(0), symbols(sm),
 		macros(localmacros), funcs(localfuncs), inclist(localinclist),
-		isseeded(false)
+		isseeded(false), inccache(0), noeval(0)
 	{ installfuncs(); }
 
 	Parser_Impl(const char* filename) : allocbuf(new Buffer(filename)),
-		lex(*allocbuf), level(0), looplevel(0), symbols(localsymmap),
+		lex(*allocbuf), level(0), symbols(localsymmap),
 		macros(localmacros), funcs(localfuncs), inclist(localinclist),
-		isseeded(false)
+		isseeded(false), inccache(0), noeval(0)
 	{ installfuncs(); }
 
 	Parser_Impl(const char* filename, Symbols& sm) : 
 		allocbuf(new Buffer(filename)), lex(*allocbuf), level(0),
-		looplevel(0), symbols(sm),
+		symbols(sm),
 		macros(localmacros), funcs(localfuncs), inclist(localinclist),
-		isseeded(false)
+		isseeded(false), inccache(0), noeval(0)
 	{ installfuncs(); }
 
 	Parser_Impl(const char* buffer, unsigned long size) :
 		allocbuf(new Buffer(buffer, size)), lex(*allocbuf), level(0),
-		looplevel(0), symbols(localsymmap), macros(localmacros),
-		funcs(localfuncs), inclist(localinclist), isseeded(false)
+		symbols(localsymmap), macros(localmacros),
+		funcs(localfuncs), inclist(localinclist), isseeded(false), inccache(0), noeval(0)
 	{ installfuncs(); }
 
 	Parser_Impl(const char* buffer, unsigned long size, Symbols& sm) :
 		allocbuf(new Buffer(buffer, size)), lex(*allocbuf), level(0),
-		looplevel(0), symbols(sm),
+		symbols(sm),
 		macros(localmacros), funcs(localfuncs), inclist(localinclist),
-		isseeded(false)
+		isseeded(false), inccache(0), noeval(0)
+	{ installfuncs(); }
+
+	Parser_Impl(const Template& t) :
+		allocbuf(new Buffer("", 0, Buffer::borrow)), code(t),
+		lex(*allocbuf), level(0), symbols(localsymmap),
+		macros(localmacros), funcs(localfuncs), inclist(localinclist),
+		isseeded(false), inccache(0), noeval(0)
+	{ installfuncs(); }
+
+	Parser_Impl(const Template& t, Symbols& sm) :
+		allocbuf(new Buffer("", 0, Buffer::borrow)), code(t),
+		lex(*allocbuf), level(0), symbols(sm),
+		macros(localmacros), funcs(localfuncs), inclist(localinclist),
+		isseeded(false), inccache(0), noeval(0)
 	{ installfuncs(); }
 
-	Parser_Impl(Buffer& buf, Symbols& sm, MacroList& ml, FunctionList& fns,
-			IncludeList& il) :
-		allocbuf(0), lex(buf), level(0), looplevel(0), symbols(sm), macros(ml),
-		funcs(fns), inclist(il), isseeded(false)
-	{ }
-	
 	~Parser_Impl() { if (allocbuf) delete allocbuf; }
 
 	void installfuncs();
@@ -133,14 +168,14 @@ public:
 
 	bool pass1(std::ostream* os);
 
-	Object parse_level0(Object& left);
-	Object parse_level1(Object& left);
-	Object parse_level2(Object& left);
-	Object parse_level3(Object& left);
-	Object parse_level4(Object& left);
-	Object parse_level5(Object& left);
-	Object parse_level6(Object& left);
-	Object parse_level7(Object& left);
+	void parse_level0(Object& value, Token<>& tok);
+	void parse_level1(Object& value, Token<>& tok);
+	void parse_level2(Object& value, Token<>& tok);
+	void parse_level3(Object& value, Token<>& tok);
+	void parse_level4(Object& value, Token<>& tok);
+	void parse_level5(Object& value, Token<>& tok);
+	void parse_level6(Object& value, Token<>& tok);
+	void parse_level7(Object& value, Token<>& tok);
 
 	void srandom32();
 	unsigned int random32();
@@ -157,10 +192,17 @@ public:
 	Token<> parse_ishash();		// check if hash
 	Token<> parse_isscalar();	// check if scalar
 
+	Token<> do_rand(Object& params);
+	Token<> do_empty(Object& params);
+	Token<> do_size(Object& params);
+	Token<> do_compare(Object& params);
+	Token<> do_isarray(Object& params);
+	Token<> do_ishash(Object& params);
+	Token<> do_isscalar(Object& params);
+
 	void parse_main(std::ostream* os);
 	void parse_block(std::ostream* os);
-	bool parse_loopblock(std::ostream* os);
-	void parse_dotoken(std::ostream* os, Token<> tok);
+	void parse_dotoken(std::ostream* os, const Token<>& tok);
 	void ignore_block();
 
 	void parse_include(std::ostream* os);
@@ -170,7 +212,7 @@ public:
 	bool parse_ifexpr(std::ostream* os);
 	void parse_foreach(std::ostream* os);
 	void parse_while(std::ostream* os);
-	bool parse_whileexpr(std::ostream* os);
+	void parse_loop(Node::node_types type, std::ostream* os);
 	void parse_set();
 	void parse_setif();
 	void parse_unset();
@@ -178,11 +220,32 @@ public:
 	void parse_pop();
 	void parse_keys();
 
+	IncludeEntry* findinclude(const std::string& fname);
+	void do_include(Object& params, std::ostream* os);
+	void do_includetext(Object& params, std::ostream* os);
+	void do_using(Object& params);
+	void do_set(const std::string& id, Object& params);
+	void do_setif(const std::string& id, Object& params);
+	void do_unset(const std::string& id, Object& params);
+	void do_push(const std::string& id, Object& params);
+	void do_pop(const std::vector< std::string >& ids);
+	void do_keys(const std::string& id, Object& params);
+
 	bool isuserfunc(const std::string& name);
 	void userfunc(const std::string& name, std::ostream* os);
+	void do_userfunc(const std::string& name, Object& params,
+		std::ostream* os);
 	
 	void parse_macro();
 	void user_macro(const std::string& name, std::ostream* os);
+	void do_usermacro(const std::string& name, Object& params,
+		std::ostream* os);
+
+	// Run a compiled Template
+	void render_main(std::ostream* os);
+	void execute(const Program& prog, std::ostream* os);
+	void popparams(Object& pl, unsigned count);
+	Token<> do_builtin(Token<>::en type, Object& params);
 };
 
 template<typename T>
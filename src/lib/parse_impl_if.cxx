@@ -70,7 +70,7 @@ bool Parser_Impl::parse_ifexpr(std::ostream* os)
 	}
 
 	int64_t lwork;
-	lwork = str2num(obj.scalar().c_str());	// lwork = result of if expression
+	lwork = obj.integer();	// lwork = result of if expression
 
 	if (lwork)	// if true, then TPT if was true
 		parse_block(os);
@@ -102,7 +102,7 @@ void Parser_Impl::parse_if(std::ostream* os)
 		else
 			done = parse_ifexpr(os);
 		saveindex = lex.index();
-		tok = lex.getstricttoken();
+		lex.getstricttoken(tok);
 		savelineno = tok.lineno;
 	}
 
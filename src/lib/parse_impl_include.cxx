@@ -35,6 +35,7 @@
 
 #include "conf.h"
 #include "parse_impl.h"
+#include <sys/stat.h>
 #include <algorithm>
 #include <sstream>
 #include <iostream>
@@ -47,6 +48,57 @@ void Parser_Impl::parse_include(std::ostream* os)
 	Object params;
 	if (getparamlist(params))
 		return;
+	do_include(params, os);
+}
+
+
+/*
+ * Find an include file by name.  Each directory in the include path is
+ * tried in order, then the name itself.  The result is remembered so
+ * that including the same name again costs only a map lookup.
+ *
+ * @return	the cache entry on success;
+ * @return	0 if the file could not be found
+ *
+ */
+IncludeEntry* Parser_Impl::findinclude(const std::string& fname)
+{
+	IncludeCache::iterator cit(includes.find(fname));
+	if (cit != includes.end())
+		return &(*cit).second;
+
+	// An empty or unreadable file is skipped, as when it was opened
+	// with Buffer.
+	struct stat st;
+	std::string path;
+	IncludeList::const_iterator it(inclist.begin()), end(inclist.end());
+	for (; it != end; ++it)
+	{
+		path = *it;
+		path+= '/';
+		path+= fname;
+		if (!stat(path.c_str(), &st) && (st.st_mode & S_IFMT) == S_IFREG &&
+				st.st_size)
+			break;
+	}
+	if (it == end)
+	{
+		path = fname;
+		if (stat(path.c_str(), &st) || (st.st_mode & S_IFMT) != S_IFREG ||
+				!st.st_size)
+		{
+			recorderror("File Error: Could not read " + fname);
+			return 0;
+		}
+	}
+	IncludeEntry& entry = includes[fname];
+	entry.path = path;
+	return &entry;
+}
+
+
+void Parser_Impl::do_include(Object& params, std::ostream* os)
+{
 	Object::ArrayType& pl = params.array();
 
 	if (pl.size() != 1)
@@ -62,45 +114,22 @@ void Parser_Impl::parse_include(std::ostream* os)
 		return;
 	}
 
-	// Create another Impl which inherits symbols table
-	// to process include
-	if (!inclist.empty())
-	{
-		IncludeList::iterator it(inclist.begin()), end(inclist.end());
-		for (; it != end; ++it)
-		{
-			std::string path(*it);
-			path+= '/';
-			path+= obj.scalar().c_str();
-			Buffer buf(path.c_str());
-			if (buf)
-			{
-				Parser_Impl incl(buf, symbols, macros, funcs, inclist);
-				if (incl.pass1(os))
-				{
-					// copy incl's error list, if any
-					ErrorList::iterator it(incl.errlist.begin()), end(incl.errlist.end());
-					for (; it != end; ++it)
-						errlist.push_back(*it);
-				}
-				return;
-			}
-		}
-	}
-	Buffer buf(obj.scalar().c_str());
-	if (!buf)
-	{
-		recorderror("File Error: Could not read " + obj.scalar());
+	IncludeEntry* entry = findinclude(obj.scalar());
+	if (!entry)
 		return;
-	}
-	Parser_Impl incl(buf, symbols, macros, funcs, inclist);
-	if (incl.pass1(os))
+	if (entry->code.empty())
 	{
-		// copy incl's error list, if any
-		ErrorList::iterator it(incl.errlist.begin()), end(incl.errlist.end());
-		for (; it != end; ++it)
-			errlist.push_back(*it);
+		if (inccache)
+			entry->code = inccache->get(entry->path.c_str());
+		else
+			entry->code = Template(entry->path.c_str());
 	}
+
+	// Run the compiled include on this parser's symbols and macros.
+	Template incl(entry->code);
+	errlist.insert(errlist.end(), incl.imp->errlist.begin(),
+		incl.imp->errlist.end());
+	execute(incl.imp->prog, os);
 }
 
 
@@ -109,6 +138,12 @@ void Parser_Impl::parse_includetext(std::ostream* os)
 	Object params;
 	if (getparamlist(params))
 		return;
+	do_includetext(params, os);
+}
+
+
+void Parser_Impl::do_includetext(Object& params, std::ostream* os)
+{
 	Object::ArrayType& pl = params.array();
 
 	if (pl.size() != 1)
@@ -124,33 +159,18 @@ void Parser_Impl::parse_includetext(std::ostream* os)
 		return;
 	}
 
-	// Create another Impl which inherits symbols table
-	// to process include
-	if (!inclist.empty())
-	{
-		IncludeList::iterator it(inclist.begin()), end(inclist.end());
-		for (; it != end; ++it)
-		{
-			std::string path(*it);
-			path+= '/';
-			path+= obj.scalar().c_str();
-			Buffer buf(path.c_str());
-			if (buf)
-			{
-				while (buf)
-					*os << buf.getnextchar();
-				return;
-			}
-		}
-	}
-	Buffer buf(obj.scalar().c_str());
-	if (!buf)
-	{
-		recorderror("File Error: Could not read " + obj.scalar());
+	IncludeEntry* entry = findinclude(obj.scalar());
+	if (!entry)
 		return;
+	if (!entry->hastext)
+	{
+		Buffer buf(entry->path.c_str());
+		while (buf)
+			entry->text+= buf.getnextchar();
+		entry->hastext = true;
 	}
-	while (buf)
-		*os << buf.getnextchar();
+	if (os)
+		os->write(entry->text.data(), entry->text.size());
 }
 
 } // end namespace TPT
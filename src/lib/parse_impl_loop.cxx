@@ -1,7 +1,7 @@
 /*
- * parse_impl_while.cxx
+ * parse_impl_loop.cxx
  *
- * Parse While Implementation
+ * Parse Foreach and While Implementation
  *
  * Copyright (C) 2002-2009 Isaac W. Foraker (isaac at noscience dot net)
  * All Rights Reserved
@@ -35,64 +35,64 @@
 
 #include "conf.h"
 #include "parse_impl.h"
-#include "funcs.h"
+#include "compile.h"
+#include <iostream>
 
 namespace TPT {
 
 
-bool Parser_Impl::parse_whileexpr(std::ostream* os)
+void Parser_Impl::parse_foreach(std::ostream* os)
 {
-	Object params;
-	if (getparamlist(params))
-		return false;
-	Object::ArrayType& pl = params.array();
-
-	if (pl.empty())
-	{
-		recorderror("Syntax error, expected expression");
-		return false;
-	}
-	else if (pl.size() > 1)
-		recorderror("Warning: extra parameters ignored");
-
-	Object& obj = *pl[0].get();
-
-	if (obj.gettype() != Object::type_scalar)
-	{
-		recorderror("Error: Excpected scalar expression");
-		return false;
-	}
-
-	int64_t lwork;
-	lwork = str2num(obj.scalar().c_str());	// lwork = result of if expression
-
-	if (lwork)	// if true, then TPT if was true
-		return parse_loopblock(os);
-	else
-		ignore_block();
-
-	return !!lwork;	// same as lwork != 0
+	parse_loop(Node::node_foreach, os);
 }
 
+
 void Parser_Impl::parse_while(std::ostream* os)
 {
-	// Create a "bookmark" of the start of the while expression.  This
-	// will allow parser to backup to expression and basically do an
-	// ifexpr to see if the
-	size_t whilestart = lex.index();
-	unsigned lineno = lex.getlineno();
+	parse_loop(Node::node_while, os);
+}
+
 
-	// Keep calling ifexpr until the expression is false
-	while (parse_whileexpr(os))
+/*
+ * Loops are compiled the first time the interpreter reaches them and
+ * the compiled code is cached by position, so the loop body is lexed
+ * once no matter how many times it is run.  If the lexer reaches the
+ * same position in a different state, such as after a pragma, the loop
+ * is compiled again.
+ *
+ */
+void Parser_Impl::parse_loop(Node::node_types type, std::ostream* os)
+{
+	Lex::State entry;
+	lex.getstate(entry);
+	LoopSiteMap::iterator it(loopsites.find(entry.index));
+	if ((it == loopsites.end()) || !(it->second.entry == entry))
 	{
-		if (lex.seek(whilestart))
-		{
-			// This should never happen.
-			recorderror("Parser internal error in @while");
-			break;
-		}
-		lex.setlineno(lineno);
+		LoopSite& site = loopsites[entry.index];
+		site.entry = entry;
+		Template_Impl* ti = new Template_Impl;
+		site.code = Template(ti);
+
+		NodeList nodes;
+		Compiler c(lex, ti->errlist);
+		if (type == Node::node_foreach)
+			c.compile_foreach(nodes, entry.lineno);
+		else
+			c.compile_while(nodes, entry.lineno);
+		lowertemplate(nodes, ti->prog);
+		deletenodes(nodes);
+		c.lex.getstate(site.exit);
+		// Report compile errors once, not on every pass through the loop
+		errlist.insert(errlist.end(), ti->errlist.begin(),
+			ti->errlist.end());
+		it = loopsites.find(entry.index);
 	}
+
+	// Hold a reference to the code while it runs
+	Template code(it->second.code);
+	Lex::State exit(it->second.exit);
+	execute(code.imp->prog, os);
+	lex.setstate(exit);
 }
 
 } // end namespace TPT
@@ -34,6 +34,7 @@
  */
 
 #include "conf.h"
+#include "compile.h"
 #include "parse_impl.h"
 #include "symbols_impl.h"
 #include <algorithm>
@@ -42,6 +43,17 @@
 
 namespace TPT {
 
+namespace {
+
+// Pop a macro's scope frame however the call ends
+struct frameguard {
+	Symbols_Impl& imp;
+	frameguard(Symbols_Impl& i) : imp(i) {}
+	~frameguard() { imp.popframe(); }
+};
+
+} // end anonymous namespace
+
 
 void Parser_Impl::parse_macro()
 {
@@ -68,10 +80,10 @@ void Parser_Impl::parse_macro()
 	Macro newmacro;
 	std::string name(tok.value);
 
-	tok = lex.getstricttoken();
+	lex.getstricttoken(tok);
 	while (tok.type == token_comma)
 	{
-		tok = lex.getstricttoken();
+		lex.getstricttoken(tok);
 		if (tok.type != token_id)
 		{
 			recorderror("Syntax error, expected identifier", &tok);
@@ -84,7 +96,7 @@ void Parser_Impl::parse_macro()
 			return;
 		}
 		newmacro.params.push_back(tok.value);
-		tok = lex.getstricttoken();
+		lex.getstricttoken(tok);
 
 		if (tok.type == token_closeparen)
 			break;
@@ -106,21 +118,34 @@ void Parser_Impl::parse_macro()
 		return;
 	}
 
-	if (lex.getblock(newmacro.body, newmacro.lineno))
+	std::string body;
+	if (lex.getblock(body, newmacro.lineno))
 	{
 		recorderror("Expected macro body {}");
 		return;
 	}
+	// Compile the body once here so calls can run it directly, and report
+	// its errors here rather than on every call.
+	newmacro.code = Template(compilemacro(body, newmacro.lineno));
+	errlist.insert(errlist.end(), newmacro.code.imp->errlist.begin(),
+		newmacro.code.imp->errlist.end());
 	macros[name] = newmacro;
 }
 
 
 void Parser_Impl::user_macro(const std::string& name, std::ostream* os)
 {
-	std::string id(name.substr(1));
 	Object params;
 	if (getparamlist(params))
 		return;
+	do_usermacro(name, params, os);
+}
+
+
+void Parser_Impl::do_usermacro(const std::string& name, Object& params,
+	std::ostream* os)
+{
+	std::string id(name.substr(1));
 	Object::ArrayType& pl = params.array();
 
 	// The id does not include the prefix @.
@@ -132,51 +157,24 @@ void Parser_Impl::user_macro(const std::string& name, std::ostream* os)
 	}
 
 	const Macro& mac = (*it).second;
-	// While processing parameters, preserve existing symbols
-	// if there is a name collision.
-	Object saveobj(Object::type_hash);
-	// savehash holds a temporary copy of the original symbols.
-	Object::HashType& savehash = saveobj.hash();
+	// Bind the parameters in a scope frame, which hides any symbols of
+	// the same names while the macro runs.
 	Symbols_Impl& symimp = *symbols.imp;
-
-	ParamList::const_iterator pit(mac.params.begin()),
-		pend(mac.params.end());
-	Object::PtrType objptr;
-	unsigned i = 0;
-	for (; pit != pend; ++pit)
+	ScopeFrame& frame = symimp.pushframe(mac.params.size());
+	frameguard guard(symimp);
+	for (size_t i = 0; i < frame.size(); ++i)
 	{
-		// Save any global IDs with conflicting identifiers.
-		if (!symimp.getobjectforget((*pit), symimp.symbols, objptr)
-				&& objptr.get())
-			savehash[*pit] = objptr;
-
+		frame[i].id = mac.params[i];
 		if (i >= pl.size())
-			symimp.symbols.hash()[*pit] = new Object("");
+			frame[i].value = new Object("");
 		else
-			symimp.symbols.hash()[*pit] = new Object(*pl[i++].get());
+			frame[i].value = pl[i];	// params are not shared
 	}
 
-	// Call the macro
-	Buffer newbuf(mac.body.c_str(), mac.body.size()+1);
-	Parser_Impl imp(newbuf, symbols, macros, funcs, inclist);
-	imp.lex.setlineno(mac.lineno);
-	imp.parse_block(os);
-
-	// Pop saved symbols off the stack
-	Object::HashType::iterator hit;
-	pit = mac.params.begin();
-	for (; pit != pend; ++pit)
-	{
-		hit = savehash.find((*pit));
-		if (hit != savehash.end())
-			symimp.symbols.hash()[(*pit)] = (*hit).second;
-		else
-		{
-			Object::HashType::iterator temp(symimp.symbols.hash().find(*pit));
-			if (temp != symimp.symbols.hash().end())
-				symimp.symbols.hash().erase(temp);
-		}
-	}
+	// Call the macro.  Hold a reference to the compiled body in case
+	// the macro is redefined while it runs.
+	Template code(mac.code);
+	execute(code.imp->prog, os);
 }
 
 
@@ -198,6 +196,13 @@ void Parser_Impl::userfunc(const std::string& name, std::ostream* os)
 	Object params;
 	if (getparamlist(params))
 		return;
+	do_userfunc(name, params, os);
+}
+
+
+void Parser_Impl::do_userfunc(const std::string& name, Object& params,
+	std::ostream* os)
+{
 	FunctionList::const_iterator it(funcs.find(name.substr(1)));
 	if (it == funcs.end())
 		return;
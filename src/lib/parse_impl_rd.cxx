@@ -50,269 +50,303 @@ namespace TPT {
  * until it reaches a token it does not recognize.  The final token
  * will usually be a comma ',', or close parenthesis ')'.
  *
+ * Each level takes the current token in tok and leaves the first token
+ * after its part of the expression there.  The result is stored in
+ * value.  Operators are matched on the kind assigned by the lexer.
+ *
  */
 
 // Level 0: Get things rolling
-Object Parser_Impl::parse_level0(Object& left)
+void Parser_Impl::parse_level0(Object& value, Token<>& tok)
 {
-	if (left.gettype() != Object::type_token)
-	{
-		recorderror("Error, expected token");
-		return left;
-	}
-	if (left.token().type == token_eof)
+	if (tok.type == token_eof)
 	{
 		recorderror("Unexpected end of file");
-		return left;
+		value = tok;
+		return;
 	}
 
-	Object right = parse_level1(left);
-
-	return right;
+	parse_level1(value, tok);
 }
 
 // Level 1: && || ^^
-Object Parser_Impl::parse_level1(Object& left)
+// The right side of && and || is only parsed, not evaluated, when the
+// left side already decides the result.
+void Parser_Impl::parse_level1(Object& value, Token<>& tok)
 {
-	Object op = parse_level2(left);
-	if (left.gettype() != Object::type_scalar)
-		return op;
-	while ((op.gettype() == Object::type_token) &&
-		(op.token().type == token_operator) &&
-		((op.token().value == "&&") ||
-		(op.token().value == "||") ||
-		(op.token().value == "^^")))
+	parse_level2(value, tok);
+	if (value.gettype() != Object::type_scalar)
+		return;
+	while ((tok.op == oper_and) || (tok.op == oper_or) ||
+		(tok.op == oper_xor))
 	{
-		Object right = lex.getstricttoken();
-		// we have left and operation, but no right
-		Object nextop = parse_level2(right);
-		int64_t lwork = str2num(left.scalar().c_str()),
-			rwork = str2num(right.scalar().c_str());
-		if (op.token().value == "&&")
+		OperatorKinds op = tok.op;
+		int64_t lwork = value.integer();
+		bool skip = noeval || ((op == oper_and) && !lwork) ||
+			((op == oper_or) && lwork);
+		Object right;
+		lex.getstricttoken(tok);
+		if (skip)
+		{
+			++noeval;
+			parse_level2(right, tok);
+			--noeval;
+			value.setinteger(op == oper_or);
+			continue;
+		}
+		parse_level2(right, tok);
+		int64_t rwork = right.integer();
+		switch (op)
+		{
+		case oper_and:
 			lwork = lwork && rwork;
-		else if (op.token().value == "||")
+			break;
+		case oper_or:
 			lwork = lwork || rwork;
-		else if (op.token().value == "^^")
+			break;
+		default:
 			lwork = !lwork ^ !rwork;
-		num2str(lwork, left.scalar());
-		// read the next operator/terminator
-		op = nextop;
+			break;
+		}
+		value.setinteger(lwork);
 	}
-
-	return op;
 }
 
 // Level 2: == != < > <= >=
-Object Parser_Impl::parse_level2(Object& left)
+void Parser_Impl::parse_level2(Object& value, Token<>& tok)
 {
-	Object op = parse_level3(left);
-	if (left.gettype() != Object::type_scalar)
-		return op;
-	while ((op.gettype() == Object::type_token) &&
-		(op.token().type == token_relop))
+	parse_level3(value, tok);
+	if (value.gettype() != Object::type_scalar)
+		return;
+	while (tok.type == token_relop)
 	{
-		Object right = lex.getstricttoken();
-		// we have left and operation, but no right
-		Object nextop = parse_level3(right);
-		int64_t lwork = str2num(left.scalar().c_str()),
-			rwork = str2num(right.scalar().c_str());
-		if (op.token().value == "==")
+		OperatorKinds op = tok.op;
+		Object right;
+		lex.getstricttoken(tok);
+		parse_level3(right, tok);
+		if (noeval)
+			continue;
+		int64_t lwork = value.integer(),
+			rwork = right.integer();
+		switch (op)
+		{
+		case oper_eq:
 			lwork = lwork == rwork;
-		else if (op.token().value == "!=")
+			break;
+		case oper_ne:
 			lwork = lwork != rwork;
-		else if (op.token().value == "<")
+			break;
+		case oper_lt:
 			lwork = lwork < rwork;
-		else if (op.token().value == ">")
+			break;
+		case oper_gt:
 			lwork = lwork > rwork;
-		else if (op.token().value == "<=")
+			break;
+		case oper_le:
 			lwork = lwork <= rwork;
-		else if (op.token().value == ">=")
+			break;
+		case oper_ge:
 			lwork = lwork >= rwork;
-		num2str(lwork, left.scalar());
-		// read the next operator/terminator
-		op = nextop;
+			break;
+		default:
+			break;
+		}
+		value.setinteger(lwork);
 	}
-	return op;
 }
 
 // Level 3: + -
-Object Parser_Impl::parse_level3(Object& left)
+void Parser_Impl::parse_level3(Object& value, Token<>& tok)
 {
-	Object op = parse_level4(left);
-	if (left.gettype() != Object::type_scalar)
-		return op;
-	while ((op.gettype() == Object::type_token) &&
-		(op.token().type == token_operator) &&
-		((op.token().value[0] == '+') ||
-		(op.token().value[0] == '-')))
+	parse_level4(value, tok);
+	if (value.gettype() != Object::type_scalar)
+		return;
+	while ((tok.op == oper_add) || (tok.op == oper_sub))
 	{
-		Object right = lex.getstricttoken();
-		// we have left and operation, but no right
-		Object nextop = parse_level4(right);
-		int64_t lwork = str2num(left.scalar().c_str()),
-			rwork = str2num(right.scalar().c_str());
-		switch (op.token().value[0])
-		{
-		case '+':
+		OperatorKinds op = tok.op;
+		Object right;
+		lex.getstricttoken(tok);
+		parse_level4(right, tok);
+		if (noeval)
+			continue;
+		int64_t lwork = value.integer(),
+			rwork = right.integer();
+		if (op == oper_add)
 			lwork+= rwork;
-			break;
-		case '-':
+		else
 			lwork-= rwork;
-			break;
-		}
-		num2str(lwork, left.scalar());
-		// read the next operator/terminator
-		op = nextop;
+		value.setinteger(lwork);
 	}
-	return op;
 }
 
 // Level 4: * / %
-Object Parser_Impl::parse_level4(Object& left)
+void Parser_Impl::parse_level4(Object& value, Token<>& tok)
 {
-	Object op = parse_level5(left);
-	if (left.gettype() != Object::type_scalar)
-		return op;
-	while ((op.gettype() == Object::type_token) &&
-		(op.token().type == token_operator) &&
-		((op.token().value[0] == '*') ||
-		(op.token().value[0] == '/') ||
-		(op.token().value[0] == '%')))
+	parse_level5(value, tok);
+	if (value.gettype() != Object::type_scalar)
+		return;
+	while ((tok.op == oper_mul) || (tok.op == oper_div) ||
+		(tok.op == oper_mod))
 	{
-		Object right = lex.getstricttoken();
-		// we have left and operation, but no right
-		Object nextop = parse_level5(right);
-		int64_t lwork = str2num(left.scalar().c_str()),
-			rwork = str2num(right.scalar().c_str());
-		switch (op.token().value[0])
+		OperatorKinds op = tok.op;
+		Object right;
+		lex.getstricttoken(tok);
+		parse_level5(right, tok);
+		if (noeval)
+			continue;
+		int64_t lwork = value.integer(),
+			rwork = right.integer();
+		switch (op)
 		{
-		case '*':
+		case oper_mul:
 			lwork*= rwork;
 			break;
-		case '/':
+		case oper_div:
 			lwork/= rwork;
 			break;
-		case '%':
+		default:
 			lwork%= rwork;
 			break;
 		}
-		num2str(lwork, left.scalar());
-		// read the next operator/terminator
-		op = nextop;
+		value.setinteger(lwork);
 	}
-	return op;
 }
 
 // Level 5: + - ! (unary operators)
-Object Parser_Impl::parse_level5(Object& left)
+void Parser_Impl::parse_level5(Object& value, Token<>& tok)
 {
-	Object right;
-	if ((left.token().type == token_operator) &&
-		((left.token().value[0] == '+') ||
-		(left.token().value[0] == '-') ||
-		(left.token().value[0] == '!')))
+	if ((tok.op == oper_add) || (tok.op == oper_sub) ||
+		(tok.op == oper_not))
 	{
-		Object temp = lex.getstricttoken();
-		right = parse_level6(temp);
-		if (temp.gettype() != Object::type_scalar)
-			return temp;
-		int64_t work = str2num(temp.scalar().c_str());
-		if (left.token().value[0] == '!')
+		OperatorKinds op = tok.op;
+		lex.getstricttoken(tok);
+		parse_level6(value, tok);
+		if (value.gettype() != Object::type_scalar)
+		{
+			// The operand cannot be used, so end the expression here
+			tok.type = token_error;
+			tok.op = oper_none;
+			return;
+		}
+		if (noeval)
+			return;
+		int64_t work = value.integer();
+		if (op == oper_not)
 			work = !work;
-		else if (left.token().value[0] == '-')
+		else if (op == oper_sub)
 			work = -work;
 		// else + ignore (forces string to 0)
-		left = Object::type_scalar;
-		num2str(work, left.scalar());
+		value.setinteger(work);
 	}
 	else
-		right = parse_level6(left);
-	return right;
+		parse_level6(value, tok);
 }
 
 // Level 6: ( )
-Object Parser_Impl::parse_level6(Object& left)
+void Parser_Impl::parse_level6(Object& value, Token<>& tok)
 {
-	Object right = parse_level7(left);
-	if ((left.gettype() == Object::type_token) &&
-		(left.token().type == token_openparen))
+	if (tok.type == token_openparen)
 	{
-		left = right;
-		right = parse_level0(left);
-		if (right.token().type != token_closeparen)
+		lex.getstricttoken(tok);
+		parse_level0(value, tok);
+		if (tok.type != token_closeparen)
 			recorderror("Syntax error, expected )");
 		else
 			// get token after close paren
-			right = lex.getstricttoken();
+			lex.getstricttoken(tok);
 	}
-	return right;
+	else
+		parse_level7(value, tok);
 }
 
 // Level 7: literals $id @macro
-Object Parser_Impl::parse_level7(Object& left)
+void Parser_Impl::parse_level7(Object& value, Token<>& tok)
 {
-	switch (left.token().type) {
+	if (noeval)
+	{
+		// Only consume the parameters of calls that are not evaluated
+		switch (tok.type) {
+		case token_usermacro:
+		case token_compare:
+		case token_empty:
+		case token_isarray:
+		case token_ishash:
+		case token_isscalar:
+		case token_rand:
+		case token_size:
+			{
+				Object params;
+				getparamlist(params);
+			}
+			// fall through
+		case token_id:
+			value = Object::type_scalar;
+			lex.getstricttoken(tok);
+			return;
+		default:
+			break;
+		}
+	}
+
+	switch (tok.type) {
 	case token_id:
-		// create copy of left.value so key is not overwritten
 		{
 			Object::PtrType objptr;
-			if (symbols.imp->getobjectforget(left.token().value,
+			if (symbols.imp->getobjectforget(tok.value,
 				symbols.imp->symbols, objptr))
 			{
 				// Object does not exist
-				left = Object::type_scalar; // empty string
+				value = Object::type_scalar; // empty string
 			}
 			else
-				left = (*objptr.get());
+				value = (*objptr.get());
 		}
 		break;
 	case token_usermacro:
 		{
 			std::stringstream tempstr;
-			if (isuserfunc(left.token().value))
-				userfunc(left.token().value, &tempstr);
+			if (isuserfunc(tok.value))
+				userfunc(tok.value, &tempstr);
 			else
-				user_macro(left.token().value, &tempstr);
-			left = tempstr.str();
+				user_macro(tok.value, &tempstr);
+			value = tempstr.str();
 		}
 		break;
 
 	case token_compare:
-		left = parse_compare().value;
+		value = parse_compare().value;
 		break;
 	case token_empty:
-		left = parse_empty().value;
+		value = parse_empty().value;
 		break;
 	case token_isarray:
-		left = parse_isarray().value;
+		value = parse_isarray().value;
 		break;
 	case token_ishash:
-		left = parse_ishash().value;
+		value = parse_ishash().value;
 		break;
 	case token_isscalar:
-		left = parse_isscalar().value;
+		value = parse_isscalar().value;
 		break;
 	case token_rand:
-		left = parse_rand().value;
+		value = parse_rand().value;
 		break;
 	case token_size:
-		left = parse_size().value;
+		value = parse_size().value;
 		break;
 
 	case token_integer:
 	case token_string:
-		{
-			// Must use temp to convert left to scalar
-			std::string temp(left.token().value);
-			left = temp;
-		}
+		// tok is about to be replaced, so take its value
+		value.scalar().swap(tok.value);
 		break;
 	default:
-		// This may be a unary operator or parenthesis
+		// Not an operand; pass the token itself up as the value
+		value = tok;
 		break;
 	}
 	// Return next available token
-	return lex.getstricttoken();
+	lex.getstricttoken(tok);
 }
 
 } // end namespace TPT
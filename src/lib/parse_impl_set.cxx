@@ -36,6 +36,7 @@
 #include "conf.h"
 #include "parse_impl.h"
 #include "symbols_impl.h"
+#include "arena.h"
 #include <algorithm>
 #include <sstream>
 #include <iostream>
@@ -49,6 +50,12 @@ void Parser_Impl::parse_unset()
 
 	if (getidparamlist(id, params))
 		return;
+	do_unset(id, params);
+}
+
+
+void Parser_Impl::do_unset(const std::string& id, Object& params)
+{
 	Object::ArrayType& pl = params.array();
 
 	if (!pl.empty())
@@ -68,6 +75,12 @@ void Parser_Impl::parse_set()
 
 	if (getidparamlist(id, params))
 		return;
+	do_set(id, params);
+}
+
+
+void Parser_Impl::do_set(const std::string& id, Object& params)
+{
 	Object::ArrayType& pl = params.array();
 
 	if (pl.empty())
@@ -92,6 +105,8 @@ void Parser_Impl::parse_set()
 			// copy scalar
 			obj = *pl[0].get();
 		}
+		// The value may share Objects made during the run
+		ObjectArena::keep(obj);
 	}
 }
 
@@ -107,6 +122,12 @@ void Parser_Impl::parse_setif()
 
 	if (getidparamlist(id, params))
 		return;
+	do_setif(id, params);
+}
+
+
+void Parser_Impl::do_setif(const std::string& id, Object& params)
+{
 	Object::ArrayType& pl = params.array();
 
 	// Only set if symbol is empty
@@ -138,6 +159,8 @@ void Parser_Impl::parse_setif()
 			// copy scalar
 			obj = *pl[0].get();
 		}
+		// The value may share Objects made during the run
+		ObjectArena::keep(obj);
 	}
 }
 
@@ -153,6 +176,12 @@ void Parser_Impl::parse_keys()
 
 	if (getidparamlist(id, params))
 		return;
+	do_keys(id, params);
+}
+
+
+void Parser_Impl::do_keys(const std::string& id, Object& params)
+{
 	Object::ArrayType& pl = params.array();
 
 	if (pl.size() != 1)
@@ -166,6 +195,7 @@ void Parser_Impl::parse_keys()
 			recorderror("Invalid symbol");
 			return;
 		}
+		ObjectArena::heapscope heap;
 		Object& aobj = *ptr.get();
 		aobj = Object::type_array;
 		Object& hobj = *(pl[0].get());
@@ -174,10 +204,18 @@ void Parser_Impl::parse_keys()
 			recorderror("Expected hash as second argument");
 			return;
 		}
+		// Hashes are not kept in key order, so sort the keys
+		std::vector< std::string > keys;
+		keys.reserve(hobj.hash().size());
 		Object::HashType::iterator it(hobj.hash().begin()),
 			end(hobj.hash().end());
 		for (; it != end; ++it)
-			aobj.array().push_back(new Object(it->first));
+			keys.push_back(it->first);
+		std::sort(keys.begin(), keys.end());
+		std::vector< std::string >::const_iterator kit(keys.begin()),
+			kend(keys.end());
+		for (; kit != kend; ++kit)
+			aobj.array().push_back(new Object(*kit));
 	}
 }
 
@@ -192,6 +230,12 @@ void Parser_Impl::parse_push()
 
 	if (getidparamlist(id, params))
 		return;
+	do_push(id, params);
+}
+
+
+void Parser_Impl::do_push(const std::string& id, Object& params)
+{
 	Object::ArrayType& pl = params.array();
 
 	Object::PtrType ptr;
@@ -204,6 +248,7 @@ void Parser_Impl::parse_push()
 	Object& obj = *ptr.get();
 	if (obj.gettype() != Object::type_array)
 		obj = Object::type_array;
+	ObjectArena::heapscope heap;
 	Object::ArrayType& array = obj.array();
 	if (pl.empty())
 		array.push_back(new Object(""));
@@ -219,6 +264,7 @@ void Parser_Impl::parse_push()
 			// push scalar
 			array.push_back(new Object(*pl[0].get()));
 		}
+		ObjectArena::keep(*array.back().get());
 	}
 }
 
@@ -228,11 +274,15 @@ void Parser_Impl::parse_push()
 void Parser_Impl::parse_pop()
 {
 	std::vector< std::string > ids;
-	Object params;
 
 	if (getidlist(ids))
 		return;
+	do_pop(ids);
+}
+
 
+void Parser_Impl::do_pop(const std::vector< std::string >& ids)
+{
 	if (ids.size() != 2)
 	{
 		recorderror("@pop takes destination and array parameters");
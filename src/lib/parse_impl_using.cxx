@@ -60,6 +60,12 @@ void Parser_Impl::parse_using()
 	Object params;
 	if (getparamlist(params))
 		return;
+	do_using(params);
+}
+
+
+void Parser_Impl::do_using(Object& params)
+{
 	Object::ArrayType& pl = params.array();
 
 	if (pl.size() != 1)
@@ -69,7 +69,7 @@ Symbols::Symbols(bool setdefaults)
 Symbols::Symbols(const Symbols& s)
 {
     imp = new Symbols_Impl(*this);
-    imp->copy(s.imp->symbols);
+    imp->assign(*s.imp);
 }
 
 
@@ -94,7 +94,22 @@ Symbols::~Symbols()
  */
 void Symbols::copy(const Symbols& sym)
 {
-    imp->copy(const_cast<Object&>(sym.imp->symbols));
+    imp->copy(*sym.imp);
+}
+
+
+/**
+ * Freeze the symbols set so far, so that copies of this table, including
+ * the copies made by Parsers, share them instead of copying each one.
+ * Symbols set after freeze() are copied as usual until the next call.
+ * Call freeze() before copying a table from several threads; copying only
+ * reads the source table.
+ *
+ * @return  nothing
+ */
+void Symbols::freeze()
+{
+    imp->freeze();
 }
 
 
@@ -106,7 +121,7 @@ void Symbols::copy(const Symbols& sym)
  */
 Symbols& Symbols::operator=(const Symbols& sym)
 {
-    imp->symbols = sym.imp->symbols;
+    imp->assign(*sym.imp);
     return *this;
 }
 
@@ -132,7 +147,10 @@ bool Symbols::get(const SymbolKeyType& id, SymbolValueType& outval) const
         return true;
     switch (pobj->gettype()) {
     case Object::type_scalar:
-        outval = pobj->scalar();
+        {
+            std::string buf;
+            outval = pobj->scalar(buf);
+        }
         break;
     case Object::type_array:
         outval = "[ARRAY]";
@@ -166,9 +184,10 @@ bool Symbols::get(const SymbolKeyType& id, SymbolArrayType& outval) const
     outval.clear();
     if (imp->getobjectforget(id, imp->symbols, pobj))
         return true;
+    std::string buf;
     switch (pobj->gettype()) {
     case Object::type_scalar:
-        outval.push_back(pobj->scalar());
+        outval.push_back(pobj->scalar(buf));
         break;
     case Object::type_array:
         {
@@ -178,7 +197,7 @@ bool Symbols::get(const SymbolKeyType& id, SymbolArrayType& outval) const
             for (; it != end; ++it) {
                 Object& aobj = *(*it);
                 if (aobj.gettype() == Object::type_scalar)
-                    outval.push_back(aobj.scalar());
+                    outval.push_back(aobj.scalar(buf));
                 // else ignore
             }
         }
@@ -344,7 +363,10 @@ bool Symbols::empty(const SymbolKeyType& id) const
         return false;
     switch (pobj->gettype()) {
     case Object::type_scalar:
-        return pobj->scalar().empty();
+        {
+            std::string buf;
+            return pobj->scalar(buf).empty();
+        }
     case Object::type_hash:
         return pobj->hash().empty();
     case Object::type_array:
@@ -34,7 +34,9 @@
 #include "conf.h"
 #include "symbols_impl.h"
 #include "eval.h"
+#include "arena.h"
 #include <libtpt/parse.h>
+#include <algorithm>
 #include <cctype>
 #include <iostream>
 #include <cassert>
@@ -42,24 +44,449 @@
 
 namespace TPT {
 
+namespace {
+
+// Layers a table may stack before share() merges them
+const unsigned maxlayerdepth = 4;
+
+// Borrow a scratch path from a table for the length of one lookup.
+// Evaluating an array index expression may look up another symbol, so
+// each nested lookup gets its own path.
+struct scratchpath {
+	Symbols_Impl& imp;
+	SymbolPath& path;
+	scratchpath(Symbols_Impl& i) : imp(i), path(i.getscratch()) {}
+	~scratchpath() { --imp.scratchdepth; }
+};
+
+/*
+ * Find key in a chain of shared layers.
+ */
+Object::PtrType* findlayer(SymbolLayer* layer, const std::string& key)
+{
+	for (; layer; layer = layer->base.get())
+	{
+		Object::HashType& hash = layer->table.hash();
+		Object::HashType::iterator it(hash.find(key));
+		if (it != hash.end())
+			return &it->second;
+	}
+	return 0;
+}
+
+/*
+ * Split id into hash keys and array indexes.
+ *
+ * @return	false on success;
+ * @return	true if id must be handled by the general code.
+ */
+bool parsesteps(const SymbolKeyType& id, SymbolPath& path)
+{
+	size_t index = 0, length = id.length();
+	for (;;)
+	{
+		// Read the hash key up to the next . or [
+		size_t start = index;
+		while (index < length && id[index] != '.' && id[index] != '[')
+			++index;
+		if (index == start)
+			return true;
+		path.push_back(SymbolStep());
+		path.back().type = SymbolStep::step_key;
+		path.back().key.assign(id, start, index - start);
+		path.back().index = 0;
+
+		// Read any array indexes that follow the key
+		while (index < length && id[index] == '[')
+		{
+			size_t cbracket = Symbols_Impl::findclosebracket(id, index);
+			if (!cbracket)
+				return true;
+			path.push_back(SymbolStep());
+			SymbolStep& step = path.back();
+			step.key.assign(id, index + 1, cbracket - index - 1);
+			step.index = 0;
+			if (Symbols_Impl::istextnumber(step.key.c_str()))
+			{
+				step.type = SymbolStep::step_index;
+				step.index = std::atoi(step.key.c_str());
+				step.key.erase();
+			}
+			else
+				step.type = SymbolStep::step_expr;
+			index = cbracket + 1;
+		}
+		if (index == length)
+			return false;
+		// The next character must start another hash key
+		if (id[index] != '.')
+			return true;
+		++index;
+	}
+}
+
+/*
+ * Find the brace that closes the embedded ${id} starting at dollar.
+ *
+ * @return	index of the closing brace;
+ * @return	0 if the id is not closed or holds other template syntax.
+ */
+size_t findclosebrace(const SymbolKeyType& id, size_t dollar)
+{
+	size_t index = dollar + 1, length = id.length();
+	if (index >= length || id[index] != '{')
+		return 0;
+	unsigned braces = 1, brackets = 0;
+	for (++index; index < length; ++index)
+	{
+		char c = id[index];
+		if (c == '$')
+		{
+			if (index + 1 >= length || id[index + 1] != '{')
+				return 0;
+		}
+		else if (c == '{')
+		{
+			if (id[index - 1] != '$')
+				return 0;
+			++braces;
+		}
+		else if (c == '}')
+		{
+			if (!--braces)
+				return brackets ? 0 : index;
+		}
+		else if (c == '[')
+			++brackets;
+		else if (c == ']')
+		{
+			if (!brackets)
+				return 0;
+			--brackets;
+		}
+		else if (c == '@' || c == '\\')
+			return 0;
+		else if (!brackets && !std::isalnum(c) && c != '_' && c != '.')
+			return 0;
+	}
+	return 0;
+}
+
+
+/*
+ * Append the value of obj as Symbols::get() would return it.
+ */
+void appendvalue(SymbolKeyType& str, const Object& obj)
+{
+	std::string buf;
+	switch (obj.gettype())
+	{
+	case Object::type_scalar:
+		str+= obj.scalar(buf);
+		break;
+	case Object::type_array:
+		str+= "[ARRAY]";
+		break;
+	case Object::type_hash:
+		str+= "[HASH]";
+		break;
+	case Object::type_notalloc:
+		str+= "[ERROR]";
+		break;
+	default:
+		break;
+	}
+}
+
+} // end anonymous namespace
+
+/*
+ * Find key in a hash Object.  At the top of the symbols table, look in
+ * the scope frames, then this table's own symbols, then the layers.
+ *
+ * @return	pointer to the key's value;
+ * @return	0 if key does not exist.
+ */
+Object::PtrType* Symbols_Impl::findkey(Object& table, const std::string& key)
+{
+	if (framedepth && &table == &symbols)
+	{
+		Object::PtrType* pobj = findframe(key);
+		if (pobj)
+			return pobj;
+	}
+	if (table.gettype() != Object::type_hash)
+		return 0;
+	Object::HashType& hash = table.hash();
+	Object::HashType::iterator it(hash.find(key));
+	if (it != hash.end())
+		return &it->second;
+	if (&table != &symbols)
+		return 0;
+	return findlayer(base.get(), key);
+}
+
+
+/*
+ * Get the value of key in a hash Object for setting, adding it if it
+ * does not exist.  A loop variable bound to an element is given its own
+ * copy of the element first, so that writes do not reach the list.
+ */
+Object::PtrType& Symbols_Impl::keyslot(Object& table, const std::string& key)
+{
+	if (&table != &symbols)
+		return table.hash()[key];
+	Object::PtrType& slot = rootslot(key);
+	if (!aliases.empty())
+	{
+		std::vector< std::string >::iterator it(std::find(aliases.begin(),
+			aliases.end(), key));
+		if (it != aliases.end())
+		{
+			aliases.erase(it);
+			if (slot.get())
+			{
+				slot = new Object(*slot.get());
+				ObjectArena::keep(*slot.get());
+			}
+		}
+	}
+	return slot;
+}
+
+
+/*
+ * Get the value of a top level key for setting.  A name bound by a scope
+ * frame is set in the frame, and a key found in a shared layer is added
+ * to this table with the same object.
+ */
+Object::PtrType& Symbols_Impl::rootslot(const std::string& key)
+{
+	if (framedepth)
+	{
+		Object::PtrType* pobj = findframe(key);
+		if (pobj)
+			return *pobj;
+	}
+	Object::HashType& hash = symbols.hash();
+	if (!base.get())
+		return hash[key];
+	Object::HashType::iterator it(hash.find(key));
+	if (it != hash.end())
+		return it->second;
+	Object::PtrType* pobj = findlayer(base.get(), key);
+	Object::PtrType& slot = hash[key];
+	if (pobj)
+		slot = *pobj;
+	return slot;
+}
+
+
+/*
+ * Bind a top level loop variable to an element without copying it.  The
+ * element is shared until the variable is set.
+ */
+void Symbols_Impl::bindalias(const std::string& key, const Object::PtrType& obj)
+{
+	rootslot(key) = obj;
+	if (std::find(aliases.begin(), aliases.end(), key) == aliases.end())
+		aliases.push_back(key);
+}
+
+
+/*
+ * Give a loop variable still bound to an element its own copy when the
+ * loop ends.
+ */
+void Symbols_Impl::unalias(const std::string& key)
+{
+	ObjectArena::heapscope heap;
+	if (std::find(aliases.begin(), aliases.end(), key) != aliases.end())
+		keyslot(symbols, key);
+}
+
+
+/*
+ * Push a scope frame for the parameters of a macro call.  Names bound in
+ * a frame hide the top level symbols of the same name, and those of any
+ * frame below it, until the frame is popped.
+ *
+ * @param	size	Number of parameters.
+ * @return	Frame to fill with the parameter names and values.
+ */
+ScopeFrame& Symbols_Impl::pushframe(size_t size)
+{
+	if (framedepth == frames.size())
+		frames.push_back(ScopeFrame());
+	ScopeFrame& frame = frames[framedepth++];
+	frame.resize(size);
+	return frame;
+}
+
+
 /*
- * Non-destructive copy of objects
+ * Pop the innermost scope frame.  The frame keeps its names' storage for
+ * the next call, but releases the values.
  */
-void Symbols_Impl::copy(Object& object)
+void Symbols_Impl::popframe()
 {
-	if (object.gettype() != Object::type_hash)
-		throw tptexception("Tried to copy non-hash symbols table");
+	ScopeFrame& frame = frames[--framedepth];
+	ScopeFrame::iterator it(frame.begin()), end(frame.end());
+	for (; it != end; ++it)
+		it->value = Object::PtrType();
+}
+
+
+/*
+ * Find a name bound by a scope frame, innermost first.
+ *
+ * @return	pointer to the name's value;
+ * @return	0 if no frame binds the name.
+ */
+Object::PtrType* Symbols_Impl::findframe(const std::string& key)
+{
+	for (size_t depth = framedepth; depth; --depth)
+	{
+		ScopeFrame& frame = frames[depth - 1];
+		// Later parameters of the same name win, as they did when
+		// each was written to the table in turn.
+		for (size_t i = frame.size(); i; --i)
+			if (frame[i - 1].id == key)
+				return &frame[i - 1].value;
+	}
+	return 0;
+}
+
+
+/*
+ * Freeze the top level symbols into a layer that copies of this table
+ * share without copying.  This table keeps reading the layer and writes
+ * new keys to its own, now empty, top level.
+ */
+void Symbols_Impl::freeze()
+{
+	Object::HashType& hash = symbols.hash();
+	if (base.get() && hash.empty())
+		return;
+	SymbolLayerPtr layer(new SymbolLayer);
+	if (base.get() && base->depth + 1 >= maxlayerdepth)
+		// Merge the layers so lookups stay short
+		flatten(layer->table.hash());
+	else
+	{
+		layer->table.hash().swap(hash);
+		layer->base = base;
+		layer->depth = base.get() ? base->depth + 1 : 0;
+	}
+	hash.clear();
+	base = layer;
+}
+
 
-	// Create references to object hashes
-	Object::HashType& rhash = object.hash();
+/*
+ * Merge all visible top level symbols into out.
+ */
+void Symbols_Impl::flatten(Object::HashType& out)
+{
+	std::vector< Object::HashType* > tables;
+	tables.push_back(&symbols.hash());
+	for (SymbolLayer* layer = base.get(); layer; layer = layer->base.get())
+		tables.push_back(&layer->table.hash());
+
+	// Apply the layers from the bottom up
+	std::vector< Object::HashType* >::reverse_iterator tit(tables.rbegin()),
+		tend(tables.rend());
+	for (; tit != tend; ++tit)
+	{
+		Object::HashType::iterator it((*tit)->begin()), end((*tit)->end());
+		for (; it != end; ++it)
+		{
+			if (it->second.get())
+				out[it->first] = it->second;
+			else
+				out.erase(it->first);
+		}
+	}
+}
+
+
+/*
+ * Non-destructive copy of symbols.  Symbols in src replace symbols of
+ * the same name in this table, which share src's objects.  src is only
+ * read, so tables in several threads may copy it at once.
+ */
+void Symbols_Impl::copy(Symbols_Impl& src)
+{
+	if (&src == this)
+		return;
 	Object::HashType& lhash = symbols.hash();
-	// Create iterators for the source hash
-	Object::HashType::iterator it(rhash.begin()), end(rhash.end());
-	for (; it != end; ++it) {
-		lhash[it->first] = it->second;
+	Object::HashType& rhash = src.symbols.hash();
+	if (!base.get() && src.base.get())
+	{
+		// Share src's layers under this table's own symbols, dropping
+		// the symbols of this table that src sets in its layers
+		base = src.base;
+		std::vector< std::string > hidden;
+		Object::HashType::iterator it(lhash.begin()), end(lhash.end());
+		for (; it != end; ++it)
+		{
+			if (rhash.count(it->first))
+				continue;
+			Object::PtrType* pobj = findlayer(base.get(), it->first);
+			if (pobj && pobj->get())
+				hidden.push_back(it->first);
+		}
+		std::vector< std::string >::const_iterator hit(hidden.begin()),
+			hend(hidden.end());
+		for (; hit != hend; ++hit)
+			lhash.erase(*hit);
+
+		// Then copy src's own top level over them
+		for (it = rhash.begin(), end = rhash.end(); it != end; ++it)
+		{
+			if (it->second.get())
+				lhash[it->first] = it->second;
+			else if (!lhash.count(it->first))
+				lhash[it->first];	// still hidden in the layers
+		}
+	}
+	else
+	{
+		// Copy each symbol that src can see
+		Object::HashType flat;
+		src.flatten(flat);
+		Object::HashType::iterator it(flat.begin()), end(flat.end());
+		for (; it != end; ++it)
+			lhash[it->first] = it->second;
+	}
+
+	// Macro parameters in scope in src are copied as symbols
+	for (size_t depth = 0; depth < src.framedepth; ++depth)
+	{
+		ScopeFrame& frame = src.frames[depth];
+		ScopeFrame::const_iterator it(frame.begin()), end(frame.end());
+		for (; it != end; ++it)
+			lhash[it->id] = it->value;
 	}
+
+	// Loop variables in src still share their elements
+	aliases.insert(aliases.end(), src.aliases.begin(), src.aliases.end());
+}
+
+
+/*
+ * Replace this table with the symbols in src, sharing src's layers and
+ * copying its own top level.  src is only read.
+ */
+void Symbols_Impl::assign(Symbols_Impl& src)
+{
+	if (&src == this)
+		return;
+	symbols.hash() = src.symbols.hash();
+	base = src.base;
+	aliases = src.aliases;
 }
-	
+
 /*
  * Recursively get an object based on the specified id.
  */
@@ -82,6 +509,7 @@ bool Symbols_Impl::setobject(const SymbolKeyType& id,
 							  const std::string& value,
 							  Object& table)
 {
+	ObjectArena::heapscope heap;
 	Object::PtrType pobj;
 	if (getobjectforset(id, table, pobj))
 		return true;
@@ -103,6 +531,7 @@ bool Symbols_Impl::setobject(const SymbolKeyType& id,
 							  const SymbolArrayType& value,
 							  Object& table)
 {
+	ObjectArena::heapscope heap;
 	Object::PtrType pobj;
 	if (getobjectforset(id, table, pobj))
 		return true;
@@ -120,6 +549,7 @@ bool Symbols_Impl::setobject(const SymbolKeyType& id,
 bool Symbols_Impl::setobject(const SymbolKeyType& id,
 	const SymbolHashType& value, Object& table)
 {
+	ObjectArena::heapscope heap;
 	Object::PtrType pobj;
 	if (getobjectforset(id, table, pobj))
 		return true;
@@ -138,11 +568,13 @@ bool Symbols_Impl::setobject(const SymbolKeyType& id,
 bool Symbols_Impl::setobject(const SymbolKeyType& id,
 	Object& value, Object& table)
 {
+	ObjectArena::heapscope heap;
 	Object::PtrType pobj;
 	if (getobjectforset(id, table, pobj))
 		return true;
 
 	*pobj = value;
+	ObjectArena::keep(*pobj);
 	return false;
 }
 
@@ -157,6 +589,7 @@ bool Symbols_Impl::pushobject(const SymbolKeyType& id,
 							  const std::string& value,
 							  Object& table)
 {
+	ObjectArena::heapscope heap;
 	Object::PtrType pobj;
 	if (getobjectforset(id, table, pobj))
 		return true;
@@ -176,6 +609,7 @@ bool Symbols_Impl::pushobject(const SymbolKeyType& id,
 							  const SymbolArrayType& value,
 							  Object& table)
 {
+	ObjectArena::heapscope heap;
 	Object::PtrType pobj;
 	if (getobjectforset(id, table, pobj))
 		return true;
@@ -195,6 +629,7 @@ bool Symbols_Impl::pushobject(const SymbolKeyType& id,
 							  const SymbolHashType& value,
 							  Object& table)
 {
+	ObjectArena::heapscope heap;
 	Object::PtrType pobj;
 	if (getobjectforset(id, table, pobj))
 		return true;
@@ -214,132 +649,241 @@ bool Symbols_Impl::pushobject(const SymbolKeyType& id,
 							  Object& value,
 							  Object& table)
 {
+	ObjectArena::heapscope heap;
 	Object::PtrType pobj;
 	if (getobjectforset(id, table, pobj))
 		return true;
 
 	pobj->array().push_back(new Object(value));
+	ObjectArena::keep(*pobj->array().back());
 	return false;
 }
 
 
 
-bool Symbols_Impl::getobjectforget(const SymbolKeyType& id, Object& table,
-									Object::PtrType& rpobj)
+/*
+ * Split an id into the steps walked by getpathforget() and
+ * getpathforset() so that it needs to be read only once.  Ids with
+ * embedded ${id} references or odd syntax are left to the general code.
+ *
+ * @return	false on success;
+ * @return	true if id cannot be split, and path is left empty.
+ */
+bool Symbols_Impl::parsepath(const SymbolKeyType& id, SymbolPath& path)
 {
-	// if table is not a hash, then can't process symbols
-//	if (table.gettype() != Object::type_hash)
-//		return true;
+	path.clear();
+	if (id.empty() || id.find('$') != SymbolKeyType::npos)
+		return true;
+	if (id == ".")	// ${.} is special foreach variable
+	{
+		path.push_back(SymbolStep());
+		path.back().type = SymbolStep::step_key;
+		path.back().key = id;
+		path.back().index = 0;
+		return false;
+	}
+	if (parsesteps(id, path))
+	{
+		path.clear();
+		return true;
+	}
+	return false;
+}
 
-	if (id[0] == '$')
-		return getobjectforget(id.substr(2, id.length()-3), symbols, rpobj);
-	else if (id.find('$') != SymbolKeyType::npos)
+
+/*
+ * Get an object from table by a path from parsepath().
+ *
+ * @return	false on success;
+ * @return	true if the object does not exist.
+ */
+bool Symbols_Impl::getpathforget(const SymbolPath& path, Object& start,
+								 Object::PtrType& rpobj)
+{
+	ObjectArena::heapscope heap;
+	Object* table = &start;
+	SymbolPath::const_iterator it(path.begin()), end(path.end());
+	for (; it != end; ++it)
 	{
-		// When id contains embedded ${id}, recurse to build new id.
-		// Note: This is really inefficient, and is only here for
-		// compatibility.
-		Buffer buf(id.c_str(), id.size());
-//		Symbols copy(parent);
-		Parser p(buf, parent);
-		SymbolKeyType newid(p.run());
-		if (p.geterrorcount())
-			return true;	// couldn't parse
-		return getobjectforget(newid, symbols, rpobj);
+		Object::PtrType* pobj;
+		if (it->type == SymbolStep::step_key)
+		{
+			pobj = findkey(*table, it->key);
+			if (!pobj)
+				return true;
+		}
+		else
+		{
+			size_t arrayindex = getstepindex(*it);
+			if (table->gettype() != Object::type_array)
+				return true;
+			Object::ArrayType& array = table->array();
+			if (arrayindex >= array.size())
+				return true;
+			pobj = &array[arrayindex];
+		}
+		if (!pobj->get())	// value did not exist
+			return true;
+		if (it + 1 == end)
+		{
+			rpobj = *pobj;
+			return false;
+		}
+		table = pobj->get();
 	}
+	return true;
+}
 
-	// Read ID character by character to determine if there is a
-	// hash or array part
-	std::string newid;
-	size_t index, length(id.length());
-	if (id == ".")	// ${.} is special foreach variable
-		newid = id;
-	else
+
+/*
+ * Get an object from table by a path from parsepath(), creating it and
+ * any missing hashes and arrays on the way.  Objects added to the table
+ * may outlive the run, so they are made on the heap.
+ *
+ * @return	false on success;
+ * @return	true if the path is invalid.
+ */
+bool Symbols_Impl::getpathforset(const SymbolPath& path, Object& start,
+								 Object::PtrType& rpobj)
+{
+	ObjectArena::heapscope heap;
+	Object* table = &start;
+	SymbolPath::const_iterator it(path.begin()), end(path.end());
+	if (it == end)
+		return true;
+	// An array index is evaluated and checked by the step before it, or
+	// here for the first step.
+	size_t arrayindex = 0;
+	if (it->type != SymbolStep::step_key)
+	{
+		arrayindex = getstepindex(*it);
+		if (arrayindex >= maxarraysize)
+			return true;
+	}
+	for (; it != end; ++it)
 	{
-		for (index = 0; index < length; ++index)
+		SymbolPath::const_iterator next(it + 1);
+		if (it->type == SymbolStep::step_key)
 		{
-			if (id[index] == '.')
+			if (next == end)
 			{
-				++index;
-				if (newid.empty())
+				// Make sure the current object is a hash of symbols.
+				if (table->gettype() != Object::type_hash)
 					return true;
-				if (table.gettype() != Object::type_hash)
-					return true;
-				// This is a hash
-				if (!table.exists(newid))
-					return true;
-				if (table.hash()[newid]->gettype() != Object::type_hash)
-					return true;
-				return getobjectforget(id.substr(index),
-					*table.hash()[newid], rpobj);
+				Object::PtrType& pobj = keyslot(*table, it->key);
+				if (!pobj.get())
+					pobj = new Object(Object::type_scalar);
+				rpobj = pobj;
+				return false;
 			}
-			else if (id[index] == '[')
+			if (next->type != SymbolStep::step_key)
 			{
-				// Find closing brace, then determine the array index in the
-				// braces.
-				size_t cbracket = findclosebracket(id, index),
-					arrayindex = getarrayindex(id.substr(index+1,
-						cbracket-index-1));
-
-				// If thie newid is not empty, table must be a hash, otherwise
-				// table should be an array.
-				if (!newid.empty())
-				{
-					// Make sure table is a hash
-					if (table.gettype() != Object::type_hash)
-						return true;
-					// If this object isn't an array, return empty
-					if (!table.exists(newid))
-						return true;
-					if (table.hash()[newid]->gettype() != Object::type_array)
-						return true;
-				}
-				else if (table.gettype() != Object::type_array)
+				arrayindex = getstepindex(*next);
+				if (arrayindex >= maxarraysize)
 					return true;
-
-				// Get a reference to the new array based on whether this
-				// object is part of a multidimensional array or a hash.
-				Object::ArrayType& array = !newid.empty() ?
-					table.hash()[newid]->array() : table.array();
-
-				// If index > arraysize, return empty
-				if (arrayindex >= array.size())
+			}
+			Object::PtrType& pobj = keyslot(*table, it->key);
+			if (next->type == SymbolStep::step_key)
+			{
+				if (!pobj.get())
+					pobj = new Object(Object::type_hash);
+			}
+			else if (!pobj.get() || pobj->gettype() != Object::type_array)
+				pobj = new Object(Object::type_array);
+			table = pobj.get();
+		}
+		else
+		{
+			if (table->gettype() != Object::type_array)
+				return true;
+			Object::ArrayType& array = table->array();
+			// Make sure target array is large enough for array index.
+			if (arrayindex >= array.size())
+				array.resize(arrayindex+1);
+			Object::PtrType& pobj = array[arrayindex];
+			if (next == end)
+			{
+				// If the array index is the last part of the identifier,
+				// then this call must be setting a scalar object.
+				pobj = new Object(Object::type_scalar);
+				rpobj = pobj;
+				return false;
+			}
+			pobj = new Object(next->type == SymbolStep::step_key ?
+				Object::type_hash : Object::type_array);
+			table = pobj.get();
+			if (next->type != SymbolStep::step_key)
+			{
+				arrayindex = getstepindex(*next);
+				if (arrayindex >= maxarraysize)
 					return true;
-				Object::PtrType pobj(array[arrayindex]);
-				// Check if there is more stuff to process
-				index = cbracket + 1;
-				if (index < id.length())
-				{
-					// The next character better be a hash . or array []
-					if ((id[index] != '[') && (id[index++] != '.'))
-						return true;
-                    return getobjectforget(id.substr(index),
-                            *array[arrayindex], rpobj);
-				}
-				else
-				{
-					rpobj = pobj;
-					return false;
-				}
 			}
-			else
-				// Add character to id
-				newid+= id[index];
 		}
 	}
+	return true;
+}
 
-	if (table.gettype() != Object::type_hash)
-		return true;
-	if (newid.empty())
-		return true;
-	Object::HashType::iterator it = table.hash().find(newid);
-	if (it == table.hash().end())
-		return true;
-	rpobj = table.hash()[newid];
-	if (!rpobj.get())	// value did not exist
+
+/*
+ * Get an object by an id and its path from parsepath().  An empty path
+ * falls back to reading the id, which handles embedded ${id}.
+ */
+bool Symbols_Impl::getobjectforget(const SymbolKeyType& id,
+								   const SymbolPath& path,
+								   Object::PtrType& rpobj)
+{
+	if (path.empty())
+		return getobjectforget(id, symbols, rpobj);
+	return getpathforget(path, symbols, rpobj);
+}
+
+
+bool Symbols_Impl::getobjectforset(const SymbolKeyType& id,
+								   const SymbolPath& path,
+								   Object::PtrType& rpobj)
+{
+	if (path.empty())
+		return getobjectforset(id, symbols, rpobj);
+	return getpathforset(path, symbols, rpobj);
+}
+
+
+/*
+ * Get an object from table by its id, expanding any embedded ${id}
+ * references first.
+ *
+ * @return	false on success;
+ * @return	true if the id is invalid or the object does not exist.
+ */
+bool Symbols_Impl::getobjectforget(const SymbolKeyType& id, Object& table,
+									Object::PtrType& rpobj)
+{
+	if (id[0] == '$')
+		return getobjectforget(id.substr(2, id.length()-3), symbols, rpobj);
+	else if (id.find('$') != SymbolKeyType::npos)
+	{
+		// When id contains embedded ${id}, expand them to build the
+		// new id.
+		SymbolKeyType newid;
+		if (expandid(id, newid))
+			return true;	// couldn't parse
+		return getobjectforget(newid, symbols, rpobj);
+	}
+
+	scratchpath path(*this);
+	if (parsepath(id, path.path))
 		return true;
-	return false;
+	return getpathforget(path.path, table, rpobj);
 }
 
+
+/*
+ * Get an object from table by its id for setting, creating it and any
+ * hashes and arrays above it as needed.
+ *
+ * @return	false on success;
+ * @return	true if the id is invalid.
+ */
 bool Symbols_Impl::getobjectforset(const SymbolKeyType& id, Object& table,
 									Object::PtrType& rpobj)
 {
@@ -347,122 +891,18 @@ bool Symbols_Impl::getobjectforset(const SymbolKeyType& id, Object& table,
 		return getobjectforset(id.substr(2, id.size()-3), symbols, rpobj);
 	else if (id.find('$') != SymbolKeyType::npos)
 	{
-		// When id contains embedded ${id}, recurse to build new id.
-		// Note: This is really inefficient, and is only here for
-		// compatibility.
-		Buffer buf(id.c_str(), id.size());
-		Parser p(buf, parent);
-		SymbolKeyType newid(p.run());
-		if (p.geterrorcount())
+		// When id contains embedded ${id}, expand them to build the
+		// new id.
+		SymbolKeyType newid;
+		if (expandid(id, newid))
 			return true;	// couldn't parse
 		return getobjectforset(newid, symbols, rpobj);
 	}
 
-	// Read ID character by character to determine if there is a hash
-	// or array part
-	std::string newid;
-	size_t index, length(id.length());
-	if (id == ".")
-		newid = id;
-	else
-	{
-		for (index = 0; index < length; ++index)
-		{
-			if (id[index] == '.')
-			{
-				++index;
-				// Make sure the symbol name is not empty.
-				if (newid.empty())
-					return true;
-				// Get reference to the hash
-				Object::HashType& hash = table.hash();
-				// Make sure the new symbol exists
-				if (hash.find(newid) == hash.end())
-					hash[newid] = new Object(Object::type_hash);
-				// Recurse on key part of hash
-                return getobjectforset(id.substr(index), *hash[newid], rpobj);
-			}
-			else if (id[index] == '[')
-			{
-				// Find closing brace, then determine the array index in the
-				// braces.
-				size_t cbracket = findclosebracket(id, index),
-					arrayindex = getarrayindex(id.substr(index+1,
-						cbracket-index-1));
-				// Make sure the array index is not beyond the allowed maximum.
-				if (arrayindex >= maxarraysize)
-					return true;
-
-				// If newid is empty, the parent must be an array.  Otherwise,
-				// the parent must be a hash.
-				if (!newid.empty())
-				{
-					// Get reference to the parent hash.
-					Object::HashType& hash = table.hash();
-					// Make sure this symbol exists as an array object.
-					if (hash.find(newid) == hash.end())
-						hash[newid] = new Object(Object::type_array);
-					else if (hash[newid]->gettype() != Object::type_array)
-						hash[newid] = new Object(Object::type_array);
-				}
-				else if (table.gettype() != Object::type_array)
-					return true;
-				// Get a reference to the new array based on whether this
-				// object is part of a multidimensional array or a hash.
-				Object::ArrayType& array = !newid.empty() ?
-					table.hash()[newid]->array() : table.array();
-				// Make sure target array is large enough for array index.
-				if (arrayindex >= array.size())
-					array.resize(arrayindex+1);
-
-				// Check if this is the end of the symbol or if there is a hash
-				// or array component still to process.
-				index = cbracket + 1;
-				if (index < id.length())
-				{
-					// The next character must be a hash . or array [index],
-					// otherwise this symbol is invalid.
-					if (id[index] == '[')
-						array[arrayindex] = new Object(Object::type_array);
-					else if (id[index++] == '.')
-						array[arrayindex] = new Object(Object::type_hash);
-					else
-						return true;
-					return getobjectforset(id.substr(index),
-							*array[arrayindex], rpobj);
-				}
-				else
-				{
-					// If the array index is the last part of the identifier,
-					// then this call must be setting a scalar object.
-					array[arrayindex] = new Object(Object::type_scalar);
-					rpobj = array[arrayindex];
-					return false;
-				}
-			}
-			else
-				// Add character to id
-				newid+= id[index];
-		}
-	}
-	// Make sure the symbol name is not empty.
-	if (newid.empty())
-		return true;
-	// Make sure the current object is a hash of symbols.
-	if (table.gettype() != Object::type_hash)
+	scratchpath path(*this);
+	if (parsepath(id, path.path))
 		return true;
-	// create new object
-	Object::HashType::iterator it(table.hash().find(newid));
-	if (it != table.hash().end())
-	{
-		rpobj = it->second;
-	}
-	else
-	{
-		rpobj = new Object(Object::type_scalar);
-		table.hash()[newid] = rpobj;
-	}
-	return false;
+	return getpathforset(path.path, table, rpobj);
 }
 
 
@@ -474,6 +914,18 @@ size_t Symbols_Impl::getarrayindex(const std::string& expr)
 		// if temp is just a number, get the number
 		arrayindex = std::atoi(expr.c_str());
 	}
+	else if (isplainid(expr))
+	{
+		// A plain symbol name is looked up instead of evaluated
+		Object::PtrType pobj;
+		std::string buf;
+		if (!getobjectforget(expr, symbols, pobj) &&
+			pobj->gettype() == Object::type_scalar)
+			arrayindex = std::atoi(pobj->scalar(buf).c_str());
+		else
+			arrayindex = std::atoi(eval("@eval(" + expr + ")",
+				&parent).c_str());
+	}
 	else
 	{
 		// otherwise instantiate a parser to handle expression
@@ -486,6 +938,79 @@ size_t Symbols_Impl::getarrayindex(const std::string& expr)
 }
 
 
+/*
+ * Expand the embedded ${id} references in id by looking them up in this
+ * table, giving the same text that a Parser run over id would.  Ids
+ * holding other template syntax are still run through a Parser.
+ *
+ * @return	false on success;
+ * @return	true if id could not be parsed.
+ */
+bool Symbols_Impl::expandid(const SymbolKeyType& id, SymbolKeyType& newid)
+{
+	size_t index = 0, length = id.length();
+	newid.erase();
+	while (index < length)
+	{
+		char c = id[index];
+		if (c != '$')
+		{
+			if (c == '@' || c == '\\' || c == '{' || c == '}')
+				return parseid(id, newid);
+			newid+= c;
+			++index;
+			continue;
+		}
+		size_t cbrace = findclosebrace(id, index);
+		if (!cbrace)
+			return parseid(id, newid);
+		Object::PtrType pobj;
+		if (!getobjectforget(id.substr(index + 2, cbrace - index - 2),
+			symbols, pobj))
+			appendvalue(newid, *pobj);
+		index = cbrace + 1;
+	}
+	return false;
+}
+
+
+/*
+ * Build a new id by running id through a Parser.
+ *
+ * @return	false on success;
+ * @return	true if id could not be parsed.
+ */
+bool Symbols_Impl::parseid(const SymbolKeyType& id, SymbolKeyType& newid)
+{
+	Buffer buf(id.c_str(), id.size(), Buffer::borrow);
+	Parser p(buf, parent);
+	newid = p.run();
+	return p.geterrorcount() != 0;
+}
+
+
+/*
+ * Get a scratch path for a lookup; scratchpath gives it back.
+ */
+SymbolPath& Symbols_Impl::getscratch()
+{
+	if (scratchdepth == scratch.size())
+		scratch.push_back(SymbolPath());
+	return scratch[scratchdepth++];
+}
+
+
+/*
+ * Get the array index of a path step.
+ */
+size_t Symbols_Impl::getstepindex(const SymbolStep& step)
+{
+	if (step.type == SymbolStep::step_index)
+		return step.index;
+	return getarrayindex(step.key);
+}
+
+
 size_t Symbols_Impl::findclosebracket(const SymbolKeyType& id, size_t obracket)
 {
 	// There is an array index here, so count brackets until close
@@ -505,6 +1030,21 @@ size_t Symbols_Impl::findclosebracket(const SymbolKeyType& id, size_t obracket)
 }
 
 
+/*
+ * Check whether expr is a plain symbol name such as "i" or "row.col".
+ */
+bool Symbols_Impl::isplainid(const std::string& expr)
+{
+	if (expr.empty() || (!std::isalpha(expr[0]) && expr[0] != '_'))
+		return false;
+	std::string::const_iterator it(expr.begin()), end(expr.end());
+	for (; it != end; ++it)
+		if (!std::isalnum(*it) && *it != '_' && *it != '.')
+			return false;
+	return true;
+}
+
+
 bool Symbols_Impl::istextnumber(const char* str)
 {
 	while (*str)
@@ -37,8 +37,10 @@
 #include <libtpt/object.h>
 #include <libtpt/symbols.h>
 #include "conf.h"
+#include "threads.h"
 #include <string>
 #include <vector>
+#include <deque>
 #include <map>
 
 namespace TPT {
@@ -59,6 +61,60 @@ struct Symbol_t {
 	}
 };
 
+/*
+ * One step of a symbol id that has been split by parsepath(): a hash
+ * key, a constant array index, or an array index expression that is
+ * evaluated on each access.
+ */
+struct SymbolStep {
+	enum step_types {
+		step_key,		// key is a hash key
+		step_index,		// index is an array index
+		step_expr		// key is an array index expression
+	};
+	step_types type;
+	std::string key;
+	size_t index;
+};
+
+// An empty path means the id could not be split and must be walked by
+// the general code.
+typedef std::vector< SymbolStep > SymbolPath;
+
+// The parameters bound by one macro call
+typedef std::vector< Symbol_t > ScopeFrame;
+
+/*
+ * A frozen level of top level symbols shared by the Symbols tables made
+ * from it.  Keys are never added to or removed from a shared layer, but
+ * the objects it holds may change, just as a copied table shares its
+ * objects with the original.
+ */
+struct SymbolLayer {
+	Object table;
+	notboost::intrusive_ptr< SymbolLayer > base;	// next layer down
+	unsigned depth;		// number of layers below this one
+	volatile long refcount;	// tables sharing this layer
+
+	SymbolLayer() : table(Object::type_hash), depth(0), refcount(0) {}
+};
+typedef notboost::intrusive_ptr< SymbolLayer > SymbolLayerPtr;
+
+/*
+ * Layers are shared by tables in different threads, so they are always
+ * counted atomically.
+ */
+inline void intrusive_ptr_add_ref(SymbolLayer* layer)
+{
+	atomicincrement(layer->refcount);
+}
+
+inline void intrusive_ptr_release(SymbolLayer* layer)
+{
+	if (!atomicdecrement(layer->refcount))
+		delete layer;
+}
+
 /*
  * The private implementation of Symbols.
  *
@@ -66,14 +122,33 @@ struct Symbol_t {
 class Symbols_Impl {
 public:
 	Symbols& parent;
-	Object symbols;
+	Object symbols;			// top level symbols set by this table
+	SymbolLayerPtr base;	// shared symbols under this table's own
 	Object emptyobject;
-
-	Symbols_Impl(Symbols& p) : parent(p), symbols(Object::type_hash), emptyobject("") {}
-	Symbols_Impl(Symbols& p, const Object& obj) : parent(p), symbols(obj), emptyobject("") {}
+	std::deque< SymbolPath > scratch;	// paths for ids passed as strings
+	size_t scratchdepth;	// scratch paths in use
+	std::deque< ScopeFrame > frames;	// macro parameter scopes
+	size_t framedepth;		// frames in use
+	std::vector< std::string > aliases;	// loop variables bound to elements
+
+	Symbols_Impl(Symbols& p) : parent(p), symbols(Object::type_hash),
+		emptyobject(""), scratchdepth(0), framedepth(0) {}
+	Symbols_Impl(Symbols& p, const Object& obj) : parent(p), symbols(obj),
+		emptyobject(""), scratchdepth(0), framedepth(0) {}
 	~Symbols_Impl() {};
 
-	void copy(Object& table);
+	ScopeFrame& pushframe(size_t size);
+	void popframe();
+	Object::PtrType* findframe(const std::string& key);
+	Object::PtrType* findkey(Object& table, const std::string& key);
+	Object::PtrType& keyslot(Object& table, const std::string& key);
+	Object::PtrType& rootslot(const std::string& key);
+	void bindalias(const std::string& key, const Object::PtrType& obj);
+	void unalias(const std::string& key);
+	void freeze();
+	void flatten(Object::HashType& out);
+	void copy(Symbols_Impl& src);
+	void assign(Symbols_Impl& src);
 
 	Object& getobject(const SymbolKeyType& id, Object& table);
 	bool setobject(const SymbolKeyType& id, const std::string& value,
@@ -98,10 +173,24 @@ public:
 		Object::PtrType& rptr);
 	bool getobjectforset(const SymbolKeyType& id, Object& table,
 		Object::PtrType& rptr);
+	bool getobjectforget(const SymbolKeyType& id, const SymbolPath& path,
+		Object::PtrType& rptr);
+	bool getobjectforset(const SymbolKeyType& id, const SymbolPath& path,
+		Object::PtrType& rptr);
+	bool getpathforget(const SymbolPath& path, Object& table,
+		Object::PtrType& rptr);
+	bool getpathforset(const SymbolPath& path, Object& table,
+		Object::PtrType& rptr);
+	SymbolPath& getscratch();
+	static bool parsepath(const SymbolKeyType& id, SymbolPath& path);
+	bool expandid(const SymbolKeyType& id, SymbolKeyType& newid);
+	bool parseid(const SymbolKeyType& id, SymbolKeyType& newid);
 	size_t getarrayindex(const std::string& expr);
+	size_t getstepindex(const SymbolStep& step);
 
-	size_t findclosebracket(const SymbolKeyType& id, size_t obracket);
-	bool istextnumber(const char* str);
+	static size_t findclosebracket(const SymbolKeyType& id, size_t obracket);
+	static bool isplainid(const std::string& expr);
+	static bool istextnumber(const char* str);
 };
 
 
@@ -0,0 +1,364 @@
+/*
+ * tcache.cxx
+ *
+ * Cache of compiled templates
+ *
+ * Copyright (C) 2010 Isaac W. Foraker (isaac at noscience dot net)
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Author nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "conf.h"
+#include "threads.h"
+#include <libtpt/tcache.h>
+#include <sys/stat.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <list>
+#include <map>
+#include <string>
+
+namespace TPT {
+
+class TemplateCache_Impl {
+public:
+    struct Entry {
+        Template tpl;
+        time_t mtime;
+        long mtimensec;
+        off_t size;
+        std::list< std::string >::iterator lrupos;
+    };
+    typedef std::map< std::string, Entry > EntryMap;
+
+    Mutex mtx;
+    EntryMap entries;
+    std::list< std::string > lru;   // most recently used first
+    unsigned long maxsize;
+    unsigned long hits;
+    unsigned long misses;
+
+    explicit TemplateCache_Impl(unsigned long ms) :
+        maxsize(ms), hits(0), misses(0) {}
+
+    void erase(EntryMap::iterator it);
+    void insert(const std::string& path, const Template& tpl,
+        const struct stat& st);
+    void trim();
+};
+
+
+/**
+ * Get the canonical form of a file name so that different spellings of
+ * the same path share one cache entry.
+ *
+ * @param   filename    Name of file.
+ * @return  The canonical path, or filename if it cannot be resolved.
+ */
+static std::string canonicalpath(const char* filename)
+{
+#ifdef _WIN32
+    char buf[_MAX_PATH];
+    if (_fullpath(buf, filename, sizeof(buf)))
+        return buf;
+#else
+    char buf[PATH_MAX];
+    if (realpath(filename, buf))
+        return buf;
+#endif
+    return filename;
+}
+
+
+/**
+ * Get the nanoseconds of a file's modification time, where the platform
+ * keeps them, so that a change within the same second is seen.
+ *
+ * @param   st          File status.
+ * @return  Nanoseconds past st_mtime, or 0.
+ */
+static long mtimensec(const struct stat& st)
+{
+#if defined(__APPLE__)
+    return st.st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+    return 0;
+#elif defined(st_mtime)
+    // st_mtime is a macro for st_mtim.tv_sec where st_mtim exists
+    return st.st_mtim.tv_nsec;
+#else
+    return 0;
+#endif
+}
+
+
+/**
+ * Remove an entry.  The caller must hold mtx.
+ *
+ * @param   it          Entry to remove.
+ * @return  nothing
+ */
+void TemplateCache_Impl::erase(EntryMap::iterator it)
+{
+    lru.erase((*it).second.lrupos);
+    entries.erase(it);
+}
+
+
+/**
+ * Add or replace an entry and make it the most recently used.  The
+ * caller must hold mtx.
+ *
+ * @param   path        Canonical path of the template file.
+ * @param   tpl         Compiled template.
+ * @param   st          File status when the template was read.
+ * @return  nothing
+ */
+void TemplateCache_Impl::insert(const std::string& path,
+    const Template& tpl, const struct stat& st)
+{
+    if (!maxsize)
+        return;
+    EntryMap::iterator it(entries.find(path));
+    if (it != entries.end())
+        erase(it);
+    lru.push_front(path);
+    Entry& e = entries[path];
+    e.tpl = tpl;
+    e.mtime = st.st_mtime;
+    e.mtimensec = mtimensec(st);
+    e.size = st.st_size;
+    e.lrupos = lru.begin();
+    trim();
+}
+
+
+/**
+ * Drop least recently used entries until the cache fits in maxsize.
+ * The caller must hold mtx.
+ *
+ * @return  nothing
+ */
+void TemplateCache_Impl::trim()
+{
+    while (entries.size() > maxsize)
+        erase(entries.find(lru.back()));
+}
+
+
+/**
+ * Construct an empty TemplateCache.
+ *
+ * @param   maxsize     Maximum number of templates to hold.
+ * @return  nothing
+ */
+TemplateCache::TemplateCache(unsigned long maxsize) :
+    imp(new TemplateCache_Impl(maxsize))
+{
+}
+
+
+/**
+ * Destruct the TemplateCache.  Templates already handed out remain
+ * valid.
+ *
+ * @return  nothing
+ */
+TemplateCache::~TemplateCache()
+{
+    delete imp;
+}
+
+
+/**
+ * Get the compiled Template for a file.  A cached Template is returned
+ * when the file's modification time and size are unchanged; otherwise
+ * the file is read and compiled, and the result is cached.  A file that
+ * cannot be found is compiled like Template(filename) but not cached.
+ *
+ * @param   filename    Name of template file.
+ * @return  The compiled Template.
+ */
+Template TemplateCache::get(const char* filename)
+{
+    std::string path(canonicalpath(filename));
+    struct stat st;
+    bool found = !stat(path.c_str(), &st);
+
+    {
+        MutexLock lock(imp->mtx);
+        if (found)
+        {
+            TemplateCache_Impl::EntryMap::iterator it(imp->entries.find(path));
+            if (it != imp->entries.end())
+            {
+                TemplateCache_Impl::Entry& e = (*it).second;
+                if (e.mtime == st.st_mtime && e.mtimensec == mtimensec(st)
+                    && e.size == st.st_size)
+                {
+                    ++imp->hits;
+                    imp->lru.splice(imp->lru.begin(), imp->lru, e.lrupos);
+                    return e.tpl;
+                }
+                imp->erase(it);
+            }
+        }
+        ++imp->misses;
+    }
+
+    // Compile without holding the lock so other lookups are not blocked.
+    Template tpl(path.c_str());
+    if (found)
+    {
+        MutexLock lock(imp->mtx);
+        imp->insert(path, tpl, st);
+    }
+    return tpl;
+}
+
+
+/**
+ * Drop a file from the cache.
+ *
+ * @param   filename    Name of template file.
+ * @return  false on success;
+ * @return  true if the file was not cached.
+ */
+bool TemplateCache::remove(const char* filename)
+{
+    std::string path(canonicalpath(filename));
+    MutexLock lock(imp->mtx);
+    TemplateCache_Impl::EntryMap::iterator it(imp->entries.find(path));
+    if (it == imp->entries.end())
+        return true;
+    imp->erase(it);
+    return false;
+}
+
+
+/**
+ * Drop every entry from the cache.
+ *
+ * @return  nothing
+ */
+void TemplateCache::clear()
+{
+    MutexLock lock(imp->mtx);
+    imp->entries.clear();
+    imp->lru.clear();
+}
+
+
+/**
+ * Set the maximum number of templates to hold, dropping the least
+ * recently used entries if there are too many.
+ *
+ * @param   maxsize     Maximum number of templates; 0 disables caching.
+ * @return  nothing
+ */
+void TemplateCache::setmaxsize(unsigned long maxsize)
+{
+    MutexLock lock(imp->mtx);
+    imp->maxsize = maxsize;
+    imp->trim();
+}
+
+
+/**
+ * Get the maximum number of templates to hold.
+ *
+ * @return  Maximum number of templates.
+ */
+unsigned long TemplateCache::getmaxsize() const
+{
+    MutexLock lock(imp->mtx);
+    return imp->maxsize;
+}
+
+
+/**
+ * Get the number of templates currently held.
+ *
+ * @return  Number of cached templates.
+ */
+unsigned long TemplateCache::size() const
+{
+    MutexLock lock(imp->mtx);
+    return imp->entries.size();
+}
+
+
+/**
+ * Get the number of lookups that were answered from the cache.
+ *
+ * @return  Hit count.
+ */
+unsigned long TemplateCache::gethits() const
+{
+    MutexLock lock(imp->mtx);
+    return imp->hits;
+}
+
+
+/**
+ * Get the number of lookups that had to read and compile the file.
+ *
+ * @return  Miss count.
+ */
+unsigned long TemplateCache::getmisses() const
+{
+    MutexLock lock(imp->mtx);
+    return imp->misses;
+}
+
+
+/**
+ * Reset the hit and miss counters to zero.
+ *
+ * @return  nothing
+ */
+void TemplateCache::resetstats()
+{
+    MutexLock lock(imp->mtx);
+    imp->hits = 0;
+    imp->misses = 0;
+}
+
+
+/**
+ * Get the process wide TemplateCache.
+ *
+ * @return  Reference to the global TemplateCache.
+ */
+TemplateCache& TemplateCache::global()
+{
+    static TemplateCache cache;
+    return cache;
+}
+
+} // end namespace TPT
@@ -0,0 +1,246 @@
+/*
+ * template.cxx
+ *
+ * Compiled template
+ *
+ * Copyright (C) 2010 Isaac W. Foraker (isaac at noscience dot net)
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Author nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "conf.h"
+#include "compile.h"
+#include "template_impl.h"
+#include <libtpt/template.h>
+
+namespace TPT {
+
+Expr::~Expr()
+{
+    deleteexprs(args);
+}
+
+
+Node::~Node()
+{
+    deleteexprs(params);
+    std::vector< ExprList >::iterator cit(conds.begin()), cend(conds.end());
+    for (; cit != cend; ++cit)
+        deleteexprs(*cit);
+    std::vector< NodeList >::iterator bit(blocks.begin()), bend(blocks.end());
+    for (; bit != bend; ++bit)
+        deletenodes(*bit);
+}
+
+
+void deleteexprs(ExprList& exprs)
+{
+    ExprList::iterator it(exprs.begin()), end(exprs.end());
+    for (; it != end; ++it)
+        delete *it;
+    exprs.clear();
+}
+
+
+void deletenodes(NodeList& nodes)
+{
+    NodeList::iterator it(nodes.begin()), end(nodes.end());
+    for (; it != end; ++it)
+        delete *it;
+    nodes.clear();
+}
+
+
+/**
+ * Construct an empty Template.
+ *
+ * @return  nothing
+ */
+Template::Template() : imp(0)
+{
+}
+
+
+/**
+ * Compile a template from a file.
+ *
+ * @param   filename    Name of template file.
+ * @return  nothing
+ */
+Template::Template(const char* filename)
+{
+    Buffer buf(filename);
+    imp = compiletemplate(buf);
+}
+
+
+/**
+ * Compile a template from a memory buffer.
+ *
+ * @param   buf         Pointer to template text.
+ * @param   size        Size of template text.
+ * @return  nothing
+ */
+Template::Template(const char* buf, unsigned long size)
+{
+    Buffer tbuf(buf, size, Buffer::borrow);
+    imp = compiletemplate(tbuf);
+}
+
+
+/**
+ * Compile a template from a Buffer.  The Buffer is read to the end.
+ *
+ * @param   buf         Buffer containing template text.
+ * @return  nothing
+ */
+Template::Template(Buffer& buf)
+{
+    imp = compiletemplate(buf);
+}
+
+
+/**
+ * Construct a Template that shares the compiled tree of another.
+ *
+ * @param   t           Template to share.
+ * @return  nothing
+ */
+Template::Template(const Template& t) : imp(t.imp)
+{
+    if (imp)
+        atomicincrement(imp->refcount);
+}
+
+
+/**
+ * Construct a Template that takes ownership of a compiled tree.
+ *
+ * @param   ti          Compiled tree, with one reference held.
+ * @return  nothing
+ */
+Template::Template(Template_Impl* ti) : imp(ti)
+{
+}
+
+
+/**
+ * Release this reference to the compiled tree.
+ *
+ * @return  nothing
+ */
+Template::~Template()
+{
+    if (imp && !atomicdecrement(imp->refcount))
+        delete imp;
+}
+
+
+/**
+ * Share the compiled tree of another Template.
+ *
+ * @param   t           Template to share.
+ * @return  Reference to *this instance of Template.
+ */
+Template& Template::operator=(const Template& t)
+{
+    if (t.imp)
+        atomicincrement(t.imp->refcount);
+    if (imp && !atomicdecrement(imp->refcount))
+        delete imp;
+    imp = t.imp;
+    return *this;
+}
+
+
+/**
+ * Check whether a template has been compiled.
+ *
+ * @return  true when this Template is empty;
+ * @return  false otherwise.
+ */
+bool Template::empty() const
+{
+    return !imp;
+}
+
+
+/**
+ * Get the number of errors found while compiling the template.
+ *
+ * @return  Number of compile errors.
+ */
+unsigned Template::geterrorcount() const
+{
+    return imp ? imp->errlist.size() : 0;
+}
+
+
+/**
+ * Get the list of errors found while compiling the template.
+ *
+ * @param   errlist     Reference to an error list to receive errors.
+ * @return  false if there are no errors;
+ * @return  true if there are errors.
+ */
+bool Template::geterrorlist(ErrorList& errlist) const
+{
+    if (!imp)
+    {
+        errlist.clear();
+        return false;
+    }
+    errlist = imp->errlist;
+    return !errlist.empty();
+}
+
+
+/**
+ * Get the number of expressions that were replaced by their value while
+ * compiling, including those in macro bodies.
+ *
+ * @return  Number of folded expressions.
+ */
+unsigned Template::getfoldcount() const
+{
+    return imp ? imp->foldedexprs : 0;
+}
+
+
+/**
+ * Get the number of @if branches and @while loops that were removed while
+ * compiling because their condition was constant.
+ *
+ * @return  Number of removed branches.
+ */
+unsigned Template::getprunecount() const
+{
+    return imp ? imp->droppedbranches : 0;
+}
+
+} // end namespace TPT
@@ -0,0 +1,151 @@
+/*
+ * template_impl.h
+ *
+ * Compiled template node tree.
+ *
+ * Copyright (C) 2010 Isaac W. Foraker (isaac at noscience dot net)
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Author nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef include_libtpt_template_impl_h
+#define include_libtpt_template_impl_h
+
+#include "threads.h"
+#include "vm.h"
+#include <libtpt/token.h>
+#include <libtpt/tpttypes.h>
+#include <libtpt/template.h>
+#include <string>
+#include <vector>
+
+namespace TPT {
+
+struct Expr;
+struct Node;
+typedef std::vector< Expr* > ExprList;
+typedef std::vector< Node* > NodeList;
+
+/*
+ * An expression node.  Expressions are compiled from the same grammar
+ * that Parser_Impl::parse_level0 through parse_level7 interpret.
+ */
+struct Expr {
+	enum expr_types {
+		expr_literal,	// integer or string literal
+		expr_symbol,	// ${id} or bare id
+		expr_unary,		// + - !
+		expr_binary,	// && || ^^ == != < > <= >= + - * / %
+		expr_call,		// @name(...), user function or macro
+		expr_builtin,	// @rand, @empty, @size, @compare, @is*
+		expr_token		// unrecognized token, kept as a token object
+	};
+
+	expr_types type;
+	Token<> tok;		// source token: literal, id, operator, or name
+	ExprList args;		// operands or parameters
+
+	Expr(expr_types t, const Token<>& source) : type(t), tok(source) {}
+	~Expr();
+
+private:
+	Expr(const Expr&);
+	Expr& operator=(const Expr&);
+};
+
+/*
+ * A statement node.  The meaning of value, params, ids and blocks
+ * depends on the node type.
+ */
+struct Node {
+	enum node_types {
+		node_text,			// value: literal text
+		node_symbol,		// value: ${id}
+		node_if,			// conds: conditions, blocks: branches [+ else]
+		node_foreach,		// value: target id, params, blocks[0]: body
+		node_while,			// params: condition, blocks[0]: body
+		node_set,			// value: id, params
+		node_setif,			// value: id, params
+		node_unset,			// value: id, params
+		node_keys,			// value: id, params
+		node_push,			// value: id, params
+		node_pop,			// ids: destination, array
+		node_include,		// params
+		node_includetext,	// params
+		node_using,			// params
+		node_macro,			// value: name, ids: parameters, code: body
+		node_call,			// value: @name, params
+		node_builtin,		// builtin: token type, params
+		node_next,
+		node_last
+	};
+
+	node_types type;
+	Token<>::en builtin;
+	std::string value;
+	ExprList params;
+	std::vector< ExprList > conds;
+	std::vector< std::string > ids;
+	std::vector< NodeList > blocks;
+	Template code;
+	unsigned lineno;
+
+	Node(node_types t, unsigned line) : type(t), builtin(token_error),
+		lineno(line) {}
+	~Node();
+
+private:
+	Node(const Node&);
+	Node& operator=(const Node&);
+};
+
+void deleteexprs(ExprList& exprs);
+void deletenodes(NodeList& nodes);
+
+/*
+ * The private implementation of Template.  The node tree is lowered to
+ * a Program once compiling is complete.
+ */
+class Template_Impl {
+public:
+	volatile long refcount;	// shared between threads by TemplateCache
+	Program prog;
+	ErrorList errlist;
+	unsigned foldedexprs;		// reported by Template::getfoldcount()
+	unsigned droppedbranches;	// reported by Template::getprunecount()
+
+	Template_Impl() : refcount(1), foldedexprs(0), droppedbranches(0) {}
+
+private:
+	Template_Impl(const Template_Impl&);
+	Template_Impl& operator=(const Template_Impl&);
+};
+
+} // end namespace TPT
+
+#endif // include_libtpt_template_impl_h
@@ -0,0 +1,119 @@
+/*
+ * threads.h
+ *
+ * Portable mutex and atomic counter helpers
+ *
+ * Copyright (C) 2010 Isaac W. Foraker (isaac at noscience dot net)
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Author nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef include_libtpt_threads_h
+#define include_libtpt_threads_h
+
+#ifdef _WIN32
+#	ifndef NOMINMAX
+#		define NOMINMAX
+#	endif
+#	include <windows.h>
+#else
+#	include <pthread.h>
+#endif
+
+/*
+ * Declare a static variable with a separate instance for each thread.
+ */
+#ifdef _WIN32
+#	define TPT_THREADLOCAL __declspec(thread)
+#else
+#	define TPT_THREADLOCAL __thread
+#endif
+
+namespace TPT {
+
+/*
+ * Non-recursive mutex.
+ */
+class Mutex {
+public:
+#ifdef _WIN32
+	Mutex() { InitializeCriticalSection(&cs); }
+	~Mutex() { DeleteCriticalSection(&cs); }
+	void lock() { EnterCriticalSection(&cs); }
+	void unlock() { LeaveCriticalSection(&cs); }
+#else
+	Mutex() { pthread_mutex_init(&mtx, 0); }
+	~Mutex() { pthread_mutex_destroy(&mtx); }
+	void lock() { pthread_mutex_lock(&mtx); }
+	void unlock() { pthread_mutex_unlock(&mtx); }
+#endif
+
+private:
+#ifdef _WIN32
+	CRITICAL_SECTION cs;
+#else
+	pthread_mutex_t mtx;
+#endif
+
+	Mutex(const Mutex&);
+	Mutex& operator=(const Mutex&);
+};
+
+/*
+ * Hold a Mutex locked for the life of the MutexLock.
+ */
+class MutexLock {
+public:
+	explicit MutexLock(Mutex& m) : mtx(m) { mtx.lock(); }
+	~MutexLock() { mtx.unlock(); }
+
+private:
+	Mutex& mtx;
+
+	MutexLock(const MutexLock&);
+	MutexLock& operator=(const MutexLock&);
+};
+
+/*
+ * Increment and decrement a shared counter, returning the new value.
+ */
+#ifdef _WIN32
+inline long atomicincrement(volatile long& v)
+{ return InterlockedIncrement(&v); }
+inline long atomicdecrement(volatile long& v)
+{ return InterlockedDecrement(&v); }
+#else
+inline long atomicincrement(volatile long& v)
+{ return __sync_add_and_fetch(&v, 1); }
+inline long atomicdecrement(volatile long& v)
+{ return __sync_sub_and_fetch(&v, 1); }
+#endif
+
+} // end namespace TPT
+
+#endif // include_libtpt_threads_h
@@ -37,7 +37,7 @@
 #define include_libtpt_vars_h
 
 // Ack!  A define!  Defines allow easy concatenation on strings
-#define LIBTPT_VERSION	"1.31"
+#define LIBTPT_VERSION	"1.34"
 
 namespace TPT {
 
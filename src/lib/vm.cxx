@@ -0,0 +1,493 @@
+/*
+ * vm.cxx
+ *
+ * Bytecode interpreter for compiled templates
+ *
+ * Copyright (C) 2010 Isaac W. Foraker (isaac at noscience dot net)
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Author nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "conf.h"
+#include "parse_impl.h"
+#include "symbols_impl.h"
+#include "arena.h"
+#include "funcs.h"
+#include <sstream>
+#include <iostream>
+
+namespace TPT {
+
+namespace {
+
+/*
+ * Restore the operand and loop stacks and the caller's line number
+ * when execute() returns, even when a user callback throws.
+ */
+struct vmguard {
+	std::vector< Object::PtrType >& stack;
+	std::vector< LoopFrame >& loops;
+	Lex& lex;
+	size_t stackbase;
+	size_t loopbase;
+	unsigned lineno;
+
+	vmguard(std::vector< Object::PtrType >& s, std::vector< LoopFrame >& l,
+		Lex& lx) :
+		stack(s), loops(l), lex(lx), stackbase(s.size()),
+		loopbase(l.size()), lineno(lx.getlineno()) {}
+	~vmguard()
+	{
+		stack.erase(stack.begin() + stackbase, stack.end());
+		loops.erase(loops.begin() + loopbase, loops.end());
+		lex.setlineno(lineno);
+	}
+};
+
+/*
+ * A loop variable named by a single top level key is bound to each
+ * element in turn instead of receiving a copy of it.
+ */
+bool isaliasvar(const std::string& var)
+{
+	return var == "." || (Symbols_Impl::isplainid(var) &&
+		var.find('.') == std::string::npos);
+}
+
+} // end anonymous namespace
+
+
+/*
+ * Render a compiled template.  Errors found while compiling are
+ * reported with each run, just as the interpreter reports them.
+ *
+ */
+void Parser_Impl::render_main(std::ostream* os)
+{
+	const Template_Impl& ti = *code.imp;
+	errlist.insert(errlist.end(), ti.errlist.begin(), ti.errlist.end());
+	execute(ti.prog, os);
+}
+
+
+/*
+ * Move the top count operands into a parameter list.
+ *
+ */
+void Parser_Impl::popparams(Object& pl, unsigned count)
+{
+	pl = Object::type_array;
+	std::vector< Object::PtrType >::iterator first(vmstack.end() - count);
+	pl.array().assign(first, vmstack.end());
+	vmstack.erase(first, vmstack.end());
+}
+
+
+Token<> Parser_Impl::do_builtin(Token<>::en type, Object& params)
+{
+	switch (type)
+	{
+	case token_rand:
+		return do_rand(params);
+	case token_empty:
+		return do_empty(params);
+	case token_size:
+		return do_size(params);
+	case token_compare:
+		return do_compare(params);
+	case token_isarray:
+		return do_isarray(params);
+	case token_ishash:
+		return do_ishash(params);
+	default:
+		return do_isscalar(params);
+	}
+}
+
+
+/*
+ * Execute a Program.  Macros defined by a compiled Template call back
+ * into execute() on the same stacks.
+ *
+ */
+void Parser_Impl::execute(const Program& prog, std::ostream* os)
+{
+	vmguard guard(vmstack, vmloops, lex);
+	const size_t stackbase = guard.stackbase;
+	loop_control loopcmd = loop_ign;
+	const unsigned end = prog.code.size();
+	unsigned pc = 0;
+
+	while (pc < end)
+	{
+		const Instr& ins = prog.code[pc++];
+		switch (ins.op)
+		{
+		case op_emit_text:
+			if (os) os->write(prog.text.data() + ins.a, ins.b);
+			break;
+		case op_emit_sym:
+			{
+				Object::PtrType objptr;
+				if (symbols.imp->getobjectforget(prog.strings[ins.a],
+					prog.paths[ins.b], objptr) || !os)
+					break;
+				// Output as Symbols::get() would
+				switch (objptr->gettype())
+				{
+				case Object::type_scalar:
+					{
+						std::string buf;
+						*os << objptr->scalar(buf);
+					}
+					break;
+				case Object::type_array:
+					*os << "[ARRAY]";
+					break;
+				case Object::type_hash:
+					*os << "[HASH]";
+					break;
+				case Object::type_notalloc:
+					*os << "[ERROR]";
+					break;
+				default:
+					break;
+				}
+			}
+			break;
+		case op_push_str:
+			vmstack.push_back(new Object(prog.strings[ins.a]));
+			break;
+		case op_push_token:
+			vmstack.push_back(new Object(prog.tokens[ins.a]));
+			break;
+		case op_load_sym:
+			{
+				Object::PtrType objptr;
+				if (symbols.imp->getobjectforget(prog.strings[ins.a],
+					prog.paths[ins.b], objptr))
+				{
+					// Object does not exist
+					vmstack.push_back(new Object(Object::type_scalar));
+				}
+				else
+					vmstack.push_back(new Object(*objptr.get()));
+			}
+			break;
+		case op_neg:
+		case op_not:
+		case op_plus:
+		case op_scalar:
+			{
+				Object& obj = *vmstack.back().get();
+				if (obj.gettype() != Object::type_scalar)
+				{
+					recorderror("Syntax error, expected comma or close parenthesis",
+						&prog.tokens[ins.a]);
+					vmstack.erase(vmstack.begin() + stackbase + ins.c,
+						vmstack.end());
+					pc = ins.b;
+					break;
+				}
+				if (ins.op == op_scalar)
+					break;
+				int64_t work = obj.integer();
+				if (ins.op == op_not)
+					work = !work;
+				else if (ins.op == op_neg)
+					work = -work;
+				// else + ignore (forces string to 0)
+				obj.setinteger(work);
+			}
+			break;
+		case op_and_jump:
+		case op_or_jump:
+			{
+				Object& obj = *vmstack.back().get();
+				bool istrue = (obj.integer() != 0);
+				if (istrue == (ins.op == op_or_jump))
+				{
+					obj.setinteger(istrue);
+					pc = ins.a;
+				}
+				else
+					vmstack.pop_back();
+			}
+			break;
+		case op_truth:
+			{
+				Object& obj = *vmstack.back().get();
+				obj.setinteger(obj.integer() != 0);
+			}
+			break;
+		case op_xor:
+		case op_eq:
+		case op_ne:
+		case op_lt:
+		case op_gt:
+		case op_le:
+		case op_ge:
+		case op_relop:
+		case op_add:
+		case op_sub:
+		case op_mul:
+		case op_div:
+		case op_mod:
+			{
+				Object& left = *vmstack[vmstack.size()-2].get();
+				if (left.gettype() != Object::type_scalar)
+				{
+					recorderror("Syntax error, expected comma or close parenthesis",
+						&prog.tokens[ins.a]);
+					vmstack.erase(vmstack.begin() + stackbase + ins.c,
+						vmstack.end());
+					pc = ins.b;
+					break;
+				}
+				int64_t lwork = left.integer(),
+					rwork = vmstack.back()->integer();
+				vmstack.pop_back();
+				switch (ins.op)
+				{
+				case op_xor: lwork = !lwork ^ !rwork; break;
+				case op_eq: lwork = lwork == rwork; break;
+				case op_ne: lwork = lwork != rwork; break;
+				case op_lt: lwork = lwork < rwork; break;
+				case op_gt: lwork = lwork > rwork; break;
+				case op_le: lwork = lwork <= rwork; break;
+				case op_ge: lwork = lwork >= rwork; break;
+				case op_add: lwork+= rwork; break;
+				case op_sub: lwork-= rwork; break;
+				case op_mul: lwork*= rwork; break;
+				case op_div: lwork/= rwork; break;
+				case op_mod: lwork%= rwork; break;
+				}
+				left.setinteger(lwork);
+			}
+			break;
+		case op_builtin:
+		case op_builtin_emit:
+			{
+				lex.setlineno(ins.line);
+				Object params;
+				popparams(params, ins.b);
+				Token<> tok(do_builtin(Token<>::en(ins.a), params));
+				if (ins.op == op_builtin)
+					vmstack.push_back(new Object(tok.value));
+				else if (os)
+					*os << tok.value;
+			}
+			break;
+		case op_call_func:
+			{
+				lex.setlineno(ins.line);
+				Object params;
+				popparams(params, ins.b);
+				std::stringstream tempstr;
+				const std::string& name = prog.strings[ins.a];
+				if (isuserfunc(name))
+					do_userfunc(name, params, &tempstr);
+				else
+					do_usermacro(name, params, &tempstr);
+				vmstack.push_back(new Object(tempstr.str()));
+			}
+			break;
+		case op_call_emit:
+			{
+				lex.setlineno(ins.line);
+				Object params;
+				popparams(params, ins.b);
+				const std::string& name = prog.strings[ins.a];
+				if (isuserfunc(name))
+					do_userfunc(name, params, os);
+				else
+					do_usermacro(name, params, os);
+			}
+			break;
+		case op_set:
+		case op_setif:
+		case op_unset:
+		case op_keys:
+		case op_push:
+			{
+				lex.setlineno(ins.line);
+				Object params;
+				popparams(params, ins.b);
+				const std::string& id = prog.strings[ins.a];
+				switch (ins.op)
+				{
+				case op_set: do_set(id, params); break;
+				case op_setif: do_setif(id, params); break;
+				case op_unset: do_unset(id, params); break;
+				case op_keys: do_keys(id, params); break;
+				case op_push: do_push(id, params); break;
+				}
+			}
+			break;
+		case op_pop:
+			lex.setlineno(ins.line);
+			do_pop(prog.idlists[ins.a]);
+			break;
+		case op_include:
+		case op_includetext:
+		case op_using:
+			{
+				lex.setlineno(ins.line);
+				Object params;
+				popparams(params, ins.b);
+				if (ins.op == op_include)
+					do_include(params, os);
+				else if (ins.op == op_includetext)
+					do_includetext(params, os);
+				else
+					do_using(params);
+			}
+			break;
+		case op_macro:
+			macros[prog.strings[ins.a]] = prog.macros[ins.b];
+			break;
+		case op_jump:
+			pc = ins.a;
+			break;
+		case op_jump_if_false:
+			{
+				// Only the first of c parameters is tested
+				Object& obj = *vmstack[vmstack.size() - ins.c].get();
+				bool scalar = (obj.gettype() == Object::type_scalar);
+				int64_t lwork = scalar ? obj.integer() : 0;
+				vmstack.erase(vmstack.end() - ins.c, vmstack.end());
+				if (!scalar)
+				{
+					lex.setlineno(ins.line);
+					recorderror("Error: Excpected scalar expression");
+					pc = ins.b;
+				}
+				else if (!lwork)
+					pc = ins.a;
+			}
+			break;
+		case op_foreach:
+			{
+				lex.setlineno(ins.line);
+				vmloops.push_back(LoopFrame());
+				LoopFrame& frame = vmloops.back();
+				frame.params = new Object;
+				frame.pit = 0;
+				frame.it = 0;
+				frame.alias = 0;
+				popparams(*frame.params.get(), ins.c);
+				const std::string& var = prog.strings[ins.a];
+				if (isaliasvar(var))
+					frame.alias = &var;
+				if (symbols.imp->getobjectforset(var,
+					symbols.imp->symbols, frame.writeobj))
+				{
+					recorderror("Invalid identifier");
+					vmloops.pop_back();
+					pc = ins.b;
+				}
+			}
+			break;
+		case op_iter_next:
+			{
+				LoopFrame& frame = vmloops.back();
+				Object::ArrayType& pl = frame.params->array();
+				bool more = false;
+				while (!more && frame.pit < pl.size())
+				{
+					Object& obj = *pl[frame.pit].get();
+					if (obj.gettype() == Object::type_array)
+					{
+						Object::ArrayType& elems = obj.array();
+						if (frame.it < elems.size())
+						{
+							if (frame.alias)
+								symbols.imp->bindalias(*frame.alias,
+									elems[frame.it++]);
+							else
+							{
+								*frame.writeobj.get() = *elems[frame.it++].get();
+								ObjectArena::keep(*frame.writeobj.get());
+							}
+							more = true;
+						}
+						else
+						{
+							++frame.pit;
+							frame.it = 0;
+						}
+					}
+					else
+					{
+						// A lone empty scalar means nothing to loop over
+						if ((pl.size() == 1) &&
+							(obj.gettype() == Object::type_scalar) &&
+							obj.scalar().empty())
+						{
+							break;
+						}
+						if (frame.alias)
+							symbols.imp->bindalias(*frame.alias, pl[frame.pit]);
+						else
+						{
+							*frame.writeobj.get() = obj;
+							ObjectArena::keep(*frame.writeobj.get());
+						}
+						++frame.pit;
+						more = true;
+					}
+				}
+				if (!more)
+					pc = ins.a;
+			}
+			break;
+		case op_iter_pop:
+			if (vmloops.back().alias)
+				symbols.imp->unalias(*vmloops.back().alias);
+			vmloops.pop_back();
+			break;
+		case op_loop_cmd:
+			loopcmd = loop_control(ins.a);
+			break;
+		case op_check:
+			if (loopcmd == loop_next)
+			{
+				loopcmd = loop_ign;
+				pc = ins.a;
+			}
+			else if (loopcmd == loop_last)
+			{
+				loopcmd = loop_ign;
+				pc = ins.b;
+			}
+			break;
+		}
+	}
+}
+
+} // end namespace TPT
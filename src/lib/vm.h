@@ -0,0 +1,138 @@
+/*
+ * vm.h
+ *
+ * Template bytecode
+ *
+ * Copyright (C) 2010 Isaac W. Foraker (isaac at noscience dot net)
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Author nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef include_libtpt_vm_h
+#define include_libtpt_vm_h
+
+#include <libtpt/object.h>
+#include <libtpt/token.h>
+#include "macro.h"
+#include "symbols_impl.h"
+#include <string>
+#include <vector>
+
+namespace TPT {
+
+/*
+ * Bytecode operations.  Expressions are evaluated on a stack of
+ * Objects.  An operation that can fail records an error, truncates the
+ * stack to depth c, and jumps to b.
+ */
+enum vm_ops {
+	op_emit_text,		// output text pool [a, a+b)
+	op_emit_sym,		// output symbol strings[a] by paths[b]
+	op_push_str,		// push scalar strings[a]
+	op_push_token,		// push token object tokens[a]
+	op_load_sym,		// push copy of symbol strings[a] by paths[b]
+	op_neg,				// unary - ; a: token for errors
+	op_not,				// unary !
+	op_plus,			// unary +
+	op_scalar,			// check top is a scalar
+	op_and_jump,		// && : if top is false set it to 0 and jump to a,
+						//   otherwise pop it
+	op_or_jump,			// || : if top is true set it to 1 and jump to a,
+						//   otherwise pop it
+	op_truth,			// replace top with 0 or 1
+	op_xor,				// ^^
+	op_eq,				// ==
+	op_ne,				// !=
+	op_lt,				// <
+	op_gt,				// >
+	op_le,				// <=
+	op_ge,				// >=
+	op_relop,			// any other relational operator
+	op_add,				// +
+	op_sub,				// -
+	op_mul,				// *
+	op_div,				// /
+	op_mod,				// %
+	op_builtin,			// push result of builtin a with b params
+	op_builtin_emit,	// output result of builtin a with b params
+	op_call_func,		// push output of @strings[a] with b params
+	op_call_emit,		// output @strings[a] with b params
+	op_set,				// statements on id strings[a] with b params
+	op_setif,
+	op_unset,
+	op_keys,
+	op_push,
+	op_pop,				// ids idlists[a]
+	op_include,			// statements with b params
+	op_includetext,
+	op_using,
+	op_macro,			// define macro strings[a] as macros[b]
+	op_jump,			// jump to a
+	op_jump_if_false,	// pop c params, jump to a if false, b on error
+	op_foreach,			// pop c params into loop for strings[a], b on error
+	op_iter_next,		// assign next loop value, or jump to a when done
+	op_iter_pop,		// discard loop
+	op_loop_cmd,		// set nested @next (1) or @last (2)
+	op_check			// jump to a on nested @next, b on nested @last
+};
+
+struct Instr {
+	unsigned op;
+	unsigned a;
+	unsigned b;
+	unsigned c;
+	unsigned line;	// source line for error reporting
+};
+
+/*
+ * A compiled template program and its constant pools.
+ */
+struct Program {
+	std::vector< Instr > code;
+	std::string text;					// literal text pool
+	std::vector< std::string > strings;	// literals, ids and names
+	std::vector< SymbolPath > paths;	// ids split by parsepath()
+	std::vector< Token<> > tokens;		// tokens kept as token objects
+	std::vector< ParamList > idlists;	// @pop ids
+	std::vector< Macro > macros;		// macro definitions
+};
+
+/*
+ * The state of a running @foreach.
+ */
+struct LoopFrame {
+	Object::PtrType params;		// flattened by iteration
+	Object::PtrType writeobj;	// loop variable
+	const std::string* alias;	// top level loop variable bound to elements
+	size_t pit;					// current parameter
+	size_t it;					// current element of an array parameter
+};
+
+} // end namespace TPT
+
+#endif // include_libtpt_vm_h
@@ -44,12 +44,16 @@
 const unsigned RUNCOUNT = 1000;
 
 void dumptemplate();
-void start();
+void rendertemplate();
+void rendercached();
+void start(const char* title, void (*run)());
 
 int main()
 {
 	try {
-		start();
+		start("Parser", &dumptemplate);
+		start("Template", &rendertemplate);
+		start("TemplateCache", &rendercached);
 	} catch(const std::exception& e) {
 		std::cout << "Exception " << e.what() << std::endl;
 	} catch(...) {
@@ -59,13 +63,14 @@ int main()
 	return 0;
 }
 
-void start()
+void start(const char* title, void (*run)())
 {
-	std::cout << "Running through " << RUNCOUNT << " loops..." << std::endl;
+	std::cout << title << ": Running through " << RUNCOUNT << " loops..."
+		<< std::endl;
 	std::clock_t starttime = std::clock();
 	for (unsigned i=0; i < RUNCOUNT; ++i)
 	{
-		dumptemplate();
+		run();
 		if (!((i+1) % (RUNCOUNT/10)))
 		{
 			std::cout << i / (RUNCOUNT/10);
@@ -86,3 +91,26 @@ void dumptemplate()
 	p.run(str);
 	// Ignore output
 }
+
+void rendertemplate()
+{
+	// Compile once, render many times
+	static const TPT::Template tpl("tests/bench.tpt");
+	std::stringstream str;
+	TPT::Parser p(tpl);
+	p.addincludepath("./tests");
+	p.run(str);
+	// Ignore output
+}
+
+void rendercached()
+{
+	// Look up the compiled template and its includes by file name on
+	// every run
+	std::stringstream str;
+	TPT::Parser p(TPT::TemplateCache::global().get("tests/bench.tpt"));
+	p.addincludepath("./tests");
+	p.setincludecache(TPT::TemplateCache::global());
+	p.run(str);
+	// Ignore output
+}
@@ -35,12 +35,19 @@
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <stdexcept>
 #include <cstring>
+#include <cstdio>
+#include <string>
 
-bool test1(const char* filename);	// file
+bool test1(const char* filename,	// file
+	TPT::Buffer::filemode mode = TPT::Buffer::streamed);
 bool test2(const char* filename);	// stream
 bool test3(const char* filename);	// memory
+bool test4(const char* filename);	// borrowed memory
+bool test5();						// window stream
+bool test6(const char* filename);	// mapped file
 // TODO: Test unget, seek, reset, and []
 
 int main(int argc, char* argv[])
@@ -69,6 +76,21 @@ int main(int argc, char* argv[])
             std::cout << "Buffer test 3: failed" << std::endl;
 		result|= r;
 
+		r = test4(argv[1]);
+        if (r)
+            std::cout << "Buffer test 4: failed" << std::endl;
+		result|= r;
+
+		r = test5();
+        if (r)
+            std::cout << "Buffer test 5: failed" << std::endl;
+		result|= r;
+
+		r = test6(argv[1]);
+        if (r)
+            std::cout << "Buffer test 6: failed" << std::endl;
+		result|= r;
+
 	} catch(const std::exception& e) {
 		result = true;
 		std::cout << "Exception - " << e.what() << std::endl;
@@ -87,9 +109,9 @@ int main(int argc, char* argv[])
 	return result;
 }
 
-bool test1(const char* filename)
+bool test1(const char* filename, TPT::Buffer::filemode mode)
 {
-	TPT::Buffer buf(filename);
+	TPT::Buffer buf(filename, mode);
 	std::fstream f(filename, std::ios::in | std::ios::binary);
 	char c, d;
 	bool filehasdata(true), bufhasdata;
@@ -227,3 +249,115 @@ bool test3(const char* filename)
 
 	return false;
 }
+
+bool test4(const char* filename)
+{
+	std::fstream f(filename, std::ios::in | std::ios::binary);
+	std::string text;
+	char c;
+
+	if (!f.is_open())
+	{
+		std::cout << "Could not open file" << std::endl;
+		return true;
+	}
+	while (f.get(c))
+		text+= c;
+
+	TPT::Buffer buf(text.data(), text.size(), TPT::Buffer::borrow);
+	std::string::size_type i;
+	for (i = 0; i < text.size(); ++i)
+	{
+		if (!buf || (buf.getnextchar() != text[i]))
+		{
+			std::cout << "Buffer does not match file" << std::endl;
+			return true;
+		}
+	}
+	if (buf || (buf.size() != text.size()))
+	{
+		std::cout << "Buffer is wrong size" << std::endl;
+		return true;
+	}
+
+	// Seek back into the borrowed memory
+	i = text.size();
+	if (i && (buf.seek(0) || (buf[i-1] != text[i-1]) ||
+			(buf.getnextchar() != text[0])))
+	{
+		std::cout << "Buffer seek failed" << std::endl;
+		return true;
+	}
+
+	return false;
+}
+
+bool test5()
+{
+	// A stream many times longer than the data a window keeps
+	std::string text;
+	std::string::size_type i;
+	for (i = 0; i < 256 * 1024; ++i)
+		text+= static_cast<char>('a' + (i * 7 + i / 4096) % 26);
+	std::istringstream is(text);
+	TPT::Buffer buf(&is, TPT::Buffer::window);
+
+	for (i = 0; i < text.size(); ++i)
+	{
+		if (!buf || (buf.getnextchar() != text[i]))
+		{
+			std::cout << "Buffer does not match stream" << std::endl;
+			return true;
+		}
+		// Keep the last 100 characters, and every 1000 characters read
+		// them again
+		if (i >= 100)
+			buf.discard(i - 100);
+		if ((i % 1000 == 999) && (buf.seek(i - 99) ||
+				(buf.getnextchar() != text[i - 99]) || buf.seek(i + 1)))
+		{
+			std::cout << "Buffer seek within window failed" << std::endl;
+			return true;
+		}
+	}
+	if (buf || (buf.size() != text.size()))
+	{
+		std::cout << "Buffer is wrong size" << std::endl;
+		return true;
+	}
+
+	// The start of the stream has been dropped
+	if (!buf.seek(0))
+	{
+		std::cout << "Buffer kept discarded data" << std::endl;
+		return true;
+	}
+	i = text.size() - 50;
+	if (buf.seek(i) || (buf.getnextchar() != text[i]) ||
+			(buf[text.size() - 1] != text[text.size() - 1]))
+	{
+		std::cout << "Buffer seek failed" << std::endl;
+		return true;
+	}
+
+	return false;
+}
+
+
+bool test6(const char* filename)
+{
+	// A file too small to map is read as usual
+	if (test1(filename, TPT::Buffer::mapped))
+		return true;
+
+	// A file large enough to map
+	const char* bigfile = "buffertest.tmp";
+	{
+		std::ofstream f(bigfile, std::ios::out | std::ios::binary);
+		for (unsigned long i = 0; i < 2 * TPT::Buffer::mapthreshold; ++i)
+			f.put(static_cast<char>('a' + i % 26));
+	}
+	bool result = test1(bigfile, TPT::Buffer::mapped);
+	std::remove(bigfile);
+	return result;
+}
@@ -79,6 +79,7 @@ void dumptemplate(const char* filename)
 
 	p.addfunction("mycallback", &mycallback);
 	p.addfunction("fsum", &fsum);
+	p.addfunction("tick", &tick);
 	p.addincludepath("tests");
 	p.run(std::cout);
 
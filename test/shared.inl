@@ -71,6 +71,19 @@ bool fsum(std::ostream& os, TPT::Object& params)
 	return false;
 }
 
+// Count calls; @tick(n) restarts the count at n
+bool tick(std::ostream& os, TPT::Object& params)
+{
+	static int count = 0;
+	TPT::Object::ArrayType& pl = params.array();
+
+	if (!pl.empty())
+		count = std::atoi((*pl[0].get()).scalar().c_str());
+	else
+		os << ++count;
+	return false;
+}
+
 // Dump a string buffer (for debug use)
 void dumpstr(const char* title, const std::string& s)
 {
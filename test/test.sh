@@ -3,8 +3,12 @@
 echo "Buffer test"
 ./buffertest buffertest.cxx
 echo "Parser test"
-./test1 54
+./test1 61
 echo "IParser test"
 ./test2 2
 echo "Object test"
 ./test3 1
+echo "Template test"
+./test4 61
+echo "Symbols test"
+./test5 6
@@ -100,6 +100,7 @@ bool test1(unsigned testcount)
 		std::stringstream strs(tptstr);
 		p.addfunction("mycallback", &mycallback);
 		p.addfunction("fsum", &fsum);
+		p.addfunction("tick", &tick);
 		p.addincludepath("tests");
 		p.run(strs);
 
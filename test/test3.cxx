@@ -139,5 +139,21 @@ dumpstr("outstr", outstr);
 		}
 	}
 
+	// Reading a numeric scalar through a buffer leaves it in binary
+	TPT::Object num;
+	num.setinteger(-42);
+	std::string buf;
+	if (num.scalar(buf) != "-42" ||
+		num.getscalartype() != TPT::Object::scalar_integer) {
+		result|= true;
+		std::cout << "scalar(buf) of an integer failed" << std::endl;
+	}
+	num.setreal(2.5);
+	if (num.scalar(buf) != "2.5" ||
+		num.getscalartype() != TPT::Object::scalar_real) {
+		result|= true;
+		std::cout << "scalar(buf) of a real failed" << std::endl;
+	}
+
 	return result;
 }
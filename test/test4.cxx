@@ -0,0 +1,349 @@
+/*
+ * test4.cxx
+ *
+ * Copyright (C) 2010 Isaac W. Foraker (isaac at noscience dot net)
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Author nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <libtpt/tpt.h>
+
+#include <iostream>
+#include <stdexcept>
+#include <sstream>
+#include <ostream>
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <ctime>
+#ifdef _WIN32
+#	include <sys/utime.h>
+#else
+#	include <utime.h>
+#	include <sys/time.h>
+#endif
+
+bool test4(unsigned testcount);
+bool testcache();
+bool testerrors();
+
+int main(int argc, char* argv[])
+{
+	bool result=false, r;
+
+	if (argc != 2) {
+		std::cout << "Usage: test4 <testcount>" << std::endl;
+		return 0;
+	}
+
+	try {
+		r = test4(std::atoi(argv[1]));
+		result|= r;
+	} catch(const std::exception& e) {
+		result = true;
+		std::cout << "Exception " << e.what() << std::endl;
+	} catch(...) {
+		result = true;
+		std::cout << "Unknown exception" << std::endl;
+	}
+	if (result)
+		std::cout << "FAILED" << std::endl;
+	else
+		std::cout << "PASSED" << std::endl;
+
+	return result;
+}
+
+#include "shared.inl"
+
+bool test4(unsigned testcount)
+{
+	TPT::ErrorList errlist;
+	bool result = false;
+	TPT::Symbols sym;
+
+	sym.set("var", "this is the value of var");
+	sym.set("var1", "Supercalifragilisticexpialidocious");
+	sym.set("var2", "The red fox runs through the plain and jumps over the fence.");
+	sym.set("title", "TEST TITLE");
+	sym.push("myarray", "value1");
+	sym.push("myarray", "value2");
+	sym.push("myarray", "value3");
+	sym.push("myarray", "value4");
+
+	char tptfile[256], outfile[256];
+	unsigned i, pass;
+	TPT::TemplateCache cache(testcount);
+
+	for (i = 0; i < testcount; ++i) {
+		// generate test file names by rule
+		sprintf(tptfile, "tests/test%u.tpt", i+1);
+		sprintf(outfile, "tests/test%u.out", i+1);
+
+		// Compile the tpt file once
+		TPT::Template tpl(tptfile);
+
+		// Load the out file
+		TPT::Buffer outbuf(outfile);
+		std::string outstr;
+		while (outbuf)
+			outstr+= outbuf.getnextchar();
+
+		// Render the same Template more than once, then render the
+		// copy held by the cache.
+		for (pass = 0; pass < 4; ++pass) {
+			TPT::Parser p(pass < 2 ? tpl : cache.get(tptfile), sym);
+			std::string tptstr;
+			std::stringstream strs(tptstr);
+			p.addfunction("mycallback", &mycallback);
+			p.addfunction("fsum", &fsum);
+			p.addfunction("tick", &tick);
+			p.addincludepath("tests");
+			p.run(strs);
+
+			if (p.geterrorlist(errlist)) {
+				std::cout << "Errors!" << std::endl;
+				TPT::ErrorList::const_iterator it(errlist.begin()), end(errlist.end());
+				for (; it != end; ++it)
+					std::cout << (*it) << std::endl;
+			}
+
+			// Compare tptstr to outstr
+			if (strs.str() != outstr) {
+				result|= true;
+				std::cout << "test" << (i+1) << ".tpt: ";
+				std::cout << "failed on pass " << (pass+1) << std::endl;
+dumpstr("tptstr", strs.str());
+dumpstr("outstr", outstr);
+			}
+		}
+	}
+
+	// Each file was compiled once by the cache and then found there.
+	if (cache.getmisses() != testcount || cache.gethits() != testcount) {
+		result|= true;
+		std::cout << "cache: " << cache.getmisses() << " misses, "
+			<< cache.gethits() << " hits" << std::endl;
+	}
+
+	// test56 is made of constant expressions and branches.
+	if (testcount >= 56) {
+		TPT::Template folded("tests/test56.tpt");
+		if (folded.getfoldcount() != 15 || folded.getprunecount() != 6) {
+			result|= true;
+			std::cout << "test56.tpt: " << folded.getfoldcount() << " folded, "
+				<< folded.getprunecount() << " pruned" << std::endl;
+		}
+	}
+
+	// test60 hides a huge @repeat in branches that are never taken, which
+	// must be dropped without being folded.
+	if (testcount >= 60) {
+		TPT::Template pruned("tests/test60.tpt");
+		if (pruned.getfoldcount() != 0 || pruned.getprunecount() != 3) {
+			result|= true;
+			std::cout << "test60.tpt: " << pruned.getfoldcount() << " folded, "
+				<< pruned.getprunecount() << " pruned" << std::endl;
+		}
+	}
+
+	result|= testcache();
+	result|= testerrors();
+
+	return result;
+}
+
+
+// Replace the contents of a file
+void writefile(const char* filename, const char* text)
+{
+	std::ofstream f(filename, std::ios::out | std::ios::trunc | std::ios::binary);
+	f << text;
+}
+
+
+// Render the template a cache holds for a file
+std::string rendercached(TPT::TemplateCache& cache, const char* filename)
+{
+	TPT::Symbols sym;
+	TPT::Parser p(cache.get(filename), sym);
+	return p.run();
+}
+
+
+bool checkcache(const char* what, TPT::TemplateCache& cache,
+	unsigned long size, unsigned long hits, unsigned long misses)
+{
+	if ((cache.size() == size) && (cache.gethits() == hits) &&
+			(cache.getmisses() == misses))
+		return false;
+	std::cout << "cache " << what << ": " << cache.size() << " entries, "
+		<< cache.gethits() << " hits, " << cache.getmisses() << " misses"
+		<< std::endl;
+	return true;
+}
+
+
+/*
+ * A cache of two templates fed three files drops the least recently used
+ * one, and compiles a file again when it changes or is removed.
+ */
+bool testcache()
+{
+	const char* files[] = {
+		"tests/cache1.tmp", "tests/cache2.tmp", "tests/cache3.tmp"
+	};
+	bool result = false;
+	unsigned i;
+
+	writefile(files[0], "one");
+	writefile(files[1], "two");
+	writefile(files[2], "three");
+
+	TPT::TemplateCache cache(2);
+	cache.get(files[0]);
+	cache.get(files[1]);
+	cache.get(files[0]);
+	result|= checkcache("fill", cache, 2, 1, 2);
+	// files[1] is the least recently used, so files[2] replaces it
+	cache.get(files[2]);
+	cache.get(files[0]);
+	result|= checkcache("evict", cache, 2, 2, 3);
+	cache.get(files[1]);
+	result|= checkcache("evicted", cache, 2, 2, 4);
+
+	// A changed file is compiled again
+	if (rendercached(cache, files[0]) != "one")
+	{
+		result|= true;
+		std::cout << "cache: wrong text before change" << std::endl;
+	}
+	writefile(files[0], "one changed");
+	if (rendercached(cache, files[0]) != "one changed")
+	{
+		result|= true;
+		std::cout << "cache: changed file not compiled again" << std::endl;
+	}
+	result|= checkcache("change", cache, 2, 3, 5);
+
+	// So is a file whose size is the same but whose time has changed
+	writefile(files[1], "TWO");
+	struct utimbuf times;
+	times.actime = times.modtime = std::time(0) - 1000;
+	utime(files[1], &times);
+	if (rendercached(cache, files[1]) != "TWO")
+	{
+		result|= true;
+		std::cout << "cache: touched file not compiled again" << std::endl;
+	}
+	result|= checkcache("touch", cache, 2, 3, 6);
+
+	// A removed file is compiled again
+	if (cache.remove(files[0]) || !cache.remove(files[0]))
+	{
+		result|= true;
+		std::cout << "cache: remove failed" << std::endl;
+	}
+	result|= checkcache("remove", cache, 1, 3, 6);
+	cache.get(files[0]);
+	result|= checkcache("after remove", cache, 2, 3, 7);
+
+	// A cache of size 0 holds nothing
+	cache.setmaxsize(0);
+	result|= checkcache("disable", cache, 0, 3, 7);
+	cache.get(files[0]);
+	cache.get(files[0]);
+	result|= checkcache("disabled", cache, 0, 3, 9);
+
+#ifndef _WIN32
+	// A file whose time has changed by less than a second is compiled again
+	TPT::TemplateCache fine(1);
+	struct timeval tv[2];
+	tv[0].tv_sec = tv[1].tv_sec = times.modtime;
+	tv[0].tv_usec = tv[1].tv_usec = 0;
+	utimes(files[1], tv);
+	rendercached(fine, files[1]);
+	writefile(files[1], "Two");
+	tv[0].tv_usec = tv[1].tv_usec = 500000;
+	utimes(files[1], tv);
+	if (rendercached(fine, files[1]) != "Two")
+	{
+		result|= true;
+		std::cout << "cache: file changed within a second not compiled again"
+			<< std::endl;
+	}
+	result|= checkcache("subsecond", fine, 1, 0, 2);
+#endif
+
+	for (i = 0; i < 3; ++i)
+		std::remove(files[i]);
+
+	return result;
+}
+
+
+// Count the errors from interpreting text
+unsigned long counterrors(const char* text)
+{
+	TPT::Symbols sym;
+	TPT::Parser p(text, std::strlen(text), sym);
+	TPT::ErrorList errlist;
+	p.run();
+	p.geterrorlist(errlist);
+	return errlist.size();
+}
+
+
+/*
+ * A syntax error in a macro body is reported once, where the macro is
+ * defined, however many times the macro is called.
+ */
+bool testerrors()
+{
+	bool result = false;
+	const char* defined = "@macro(bad, x) { @if (1 { y } }";
+	unsigned long once = counterrors(defined);
+	unsigned long called = counterrors(
+		"@macro(bad, x) { @if (1 { y } }@bad(1)@bad(2)@bad(3)");
+	if (!once || called != once)
+	{
+		result|= true;
+		std::cout << "errors: macro called 3 times reported " << called
+			<< " errors, not " << once << std::endl;
+	}
+
+	TPT::Template tpl(defined, std::strlen(defined));
+	if (tpl.geterrorcount() != once)
+	{
+		result|= true;
+		std::cout << "errors: compiled macro reported "
+			<< tpl.geterrorcount() << " errors, not " << once << std::endl;
+	}
+	return result;
+}
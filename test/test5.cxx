@@ -0,0 +1,328 @@
+/*
+ * test5.cxx
+ *
+ * Copyright (C) 2010 Isaac W. Foraker (isaac at noscience dot net)
+ * All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Author nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <libtpt/tpt.h>
+#include "../src/lib/arena.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <sstream>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <vector>
+#ifdef _WIN32
+#	include <windows.h>
+#else
+#	include <pthread.h>
+#endif
+
+bool test5(unsigned testcount);
+
+int main(int argc, char* argv[])
+{
+	bool result=false, r;
+
+	if (argc != 2) {
+		std::cout << "Usage: test5 <testcount>" << std::endl;
+		return 0;
+	}
+
+	try {
+		r = test5(std::atoi(argv[1]));
+		result|= r;
+	} catch(const std::exception& e) {
+		result = true;
+		std::cout << "Exception " << e.what() << std::endl;
+	} catch(...) {
+		result = true;
+		std::cout << "Unknown exception" << std::endl;
+	}
+	if (result)
+		std::cout << "FAILED" << std::endl;
+	else
+		std::cout << "PASSED" << std::endl;
+
+	return result;
+}
+
+// Get a symbol's value, or "-" when it is not set
+std::string getvalue(const TPT::Symbols& sym, const char* id)
+{
+	std::string value;
+	if (!sym.exists(id))
+		return "-";
+	sym.get(id, value);
+	return value;
+}
+
+// Render src with a parser made from sym
+std::string render(const char* src, TPT::Symbols& sym)
+{
+	TPT::Buffer buf(src, std::strlen(src));
+	TPT::Parser p(buf, sym);
+	return p.run();
+}
+
+bool check(unsigned test, const char* what, const std::string& value,
+	const char* expected)
+{
+	if (value == expected)
+		return false;
+	std::cout << "symbols test" << test << ": " << what << " is \""
+		<< value << "\", expected \"" << expected << "\"" << std::endl;
+	return true;
+}
+
+/*
+ * Make parsers from one frozen table in a thread of their own.  Copying
+ * a table only reads it, but running the parsers in several threads also
+ * needs atomic reference counts, so without them the parsers are run
+ * once the threads are done.
+ */
+const unsigned parsersperthread = 50;
+const char* threadsrc = "${greeting} ${n}@set(mine, ${n} + 1) ${mine}";
+
+struct parserjob {
+	const TPT::Symbols* sym;
+	std::vector< TPT::Parser* > parsers;
+	std::vector< std::string > results;
+};
+
+void runjob(parserjob& job)
+{
+	for (unsigned i = 0; i < parsersperthread; ++i) {
+		job.parsers.push_back(new TPT::Parser(threadsrc,
+			std::strlen(threadsrc), *job.sym));
+#if LIBTPT_ATOMIC_REFCOUNT
+		job.results.push_back(job.parsers.back()->run());
+#endif
+	}
+}
+
+#ifdef _WIN32
+DWORD WINAPI jobthread(LPVOID arg)
+{
+	runjob(*static_cast< parserjob* >(arg));
+	return 0;
+}
+#else
+extern "C" void* jobthread(void* arg)
+{
+	runjob(*static_cast< parserjob* >(arg));
+	return 0;
+}
+#endif
+
+/*
+ * Each test copies symbols tables and checks what each table sees.  A
+ * copy shares the objects of the symbols it was copied from, so setting
+ * or unsetting a symbol that both tables hold changes it in both, while
+ * a new symbol is seen only by the table that set it.
+ */
+bool test5(unsigned testcount)
+{
+	bool result = false;
+	char id[16], value[16];
+	unsigned i;
+
+	// Copies of copies, deeper than the layers kept before merging
+	if (testcount >= 1) {
+		TPT::Symbols* chain[10];
+		chain[0] = new TPT::Symbols(false);
+		chain[0]->set("a", "0");
+		for (i = 1; i < 10; ++i) {
+			chain[i] = new TPT::Symbols(*chain[i-1]);
+			std::sprintf(id, "k%u", i);
+			std::sprintf(value, "%u", i);
+			chain[i]->set(id, value);
+			chain[i]->set("a", value);
+		}
+		result|= check(1, "chain[9].a", getvalue(*chain[9], "a"), "9");
+		result|= check(1, "chain[9].k1", getvalue(*chain[9], "k1"), "1");
+		result|= check(1, "chain[9].k9", getvalue(*chain[9], "k9"), "9");
+		result|= check(1, "chain[4].a", getvalue(*chain[4], "a"), "9");
+		result|= check(1, "chain[4].k5", getvalue(*chain[4], "k5"), "-");
+		result|= check(1, "chain[0].k1", getvalue(*chain[0], "k1"), "-");
+		result|= check(1, "render chain[9]", render("${a}${k1}${k5}${k9}",
+			*chain[9]), "9159");
+		result|= check(1, "render chain[0]", render("${a}${k1}", *chain[0]),
+			"9");
+		for (i = 0; i < 10; ++i)
+			delete chain[i];
+	}
+
+	// unset in a copy empties the shared symbol, but a new one is local
+	if (testcount >= 2) {
+		TPT::Symbols s(false);
+		s.set("a", "1");
+		s.set("b", "2");
+		TPT::Symbols t(s);
+		t.unset("a");
+		result|= check(2, "t.a", getvalue(t, "a"), "");
+		result|= check(2, "s.a", getvalue(s, "a"), "");
+		TPT::Symbols u(t);
+		result|= check(2, "u.a", getvalue(u, "a"), "");
+		result|= check(2, "u.b", getvalue(u, "b"), "2");
+		u.set("a", "3");
+		result|= check(2, "u.a after set", getvalue(u, "a"), "3");
+		result|= check(2, "t.a after set", getvalue(t, "a"), "3");
+		result|= check(2, "render t", render("[${a}${b}]", t), "[32]");
+	}
+
+	// Writes to the original after a copy
+	if (testcount >= 3) {
+		TPT::Symbols s(false);
+		s.set("a", "1");
+		TPT::Symbols t(s);
+		s.set("a", "2");
+		s.set("n", "new");
+		s.unset("a");
+		result|= check(3, "t.a", getvalue(t, "a"), "");
+		result|= check(3, "t.n", getvalue(t, "n"), "-");
+		result|= check(3, "s.a", getvalue(s, "a"), "");
+		t.set("a", "3");
+		result|= check(3, "s.a after t", getvalue(s, "a"), "3");
+		result|= check(3, "t.a after t", getvalue(t, "a"), "3");
+	}
+
+	// Symbols::copy() onto a table with unset keys of its own
+	if (testcount >= 4) {
+		TPT::Symbols s(false);
+		s.set("a", "1");
+		s.set("b", "2");
+		TPT::Symbols t(s);
+		t.unset("a");
+		t.set("own", "t");
+		TPT::Symbols u(false);
+		u.set("a", "u");
+		u.set("c", "3");
+		t.copy(u);
+		result|= check(4, "t.a", getvalue(t, "a"), "u");
+		result|= check(4, "t.b", getvalue(t, "b"), "2");
+		result|= check(4, "t.c", getvalue(t, "c"), "3");
+		result|= check(4, "t.own", getvalue(t, "own"), "t");
+		result|= check(4, "s.a", getvalue(s, "a"), "");
+		result|= check(4, "s.c", getvalue(s, "c"), "-");
+		TPT::Symbols w(false);
+		w.set("b", "w");
+		w.set("keep", "w");
+		w.copy(s);
+		s.set("late", "s");
+		result|= check(4, "w.b", getvalue(w, "b"), "2");
+		result|= check(4, "w.keep", getvalue(w, "keep"), "w");
+		result|= check(4, "w.late", getvalue(w, "late"), "-");
+		w.copy(t);
+		result|= check(4, "w.c after copy", getvalue(w, "c"), "3");
+		result|= check(4, "w.keep after copy", getvalue(w, "keep"), "w");
+		result|= check(4, "render w", render("${a}${b}${c}${keep}${own}", w),
+			"u23wt");
+		TPT::Symbols v(false);
+		v.set("b", "v");
+		v.set("gone", "x");
+		v = t;
+		result|= check(4, "v.gone", getvalue(v, "gone"), "-");
+		result|= check(4, "v.b", getvalue(v, "b"), "2");
+		result|= check(4, "v.a", getvalue(v, "a"), "u");
+	}
+
+	// Parsers made from one frozen table by several threads at once
+	if (testcount >= 5) {
+		const unsigned threadcount = 8;
+		TPT::Symbols s(false);
+		s.set("greeting", "hello");
+		s.set("n", "7");
+		s.freeze();
+		parserjob jobs[threadcount];
+#ifdef _WIN32
+		HANDLE threads[threadcount];
+#else
+		pthread_t threads[threadcount];
+#endif
+		for (i = 0; i < threadcount; ++i) {
+			jobs[i].sym = &s;
+#ifdef _WIN32
+			threads[i] = CreateThread(0, 0, jobthread, &jobs[i], 0, 0);
+#else
+			pthread_create(&threads[i], 0, jobthread, &jobs[i]);
+#endif
+		}
+		for (i = 0; i < threadcount; ++i) {
+#ifdef _WIN32
+			WaitForSingleObject(threads[i], INFINITE);
+			CloseHandle(threads[i]);
+#else
+			pthread_join(threads[i], 0);
+#endif
+			parserjob& job = jobs[i];
+			if (job.parsers.size() != parsersperthread)
+				result|= check(5, "thread parsers", "too few", "all");
+			for (unsigned j = 0; j < job.parsers.size(); ++j) {
+				if (j >= job.results.size())
+					job.results.push_back(job.parsers[j]->run());
+				result|= check(5, "thread parser", job.results[j], "hello 7 8");
+				delete job.parsers[j];
+			}
+		}
+		result|= check(5, "s.greeting", getvalue(s, "greeting"), "hello");
+		result|= check(5, "s.mine", getvalue(s, "mine"), "-");
+	}
+
+	// Symbols a template stores must not hold the chunks of its run
+	if (testcount >= 6) {
+		const char* src =
+			"@set(i, 0)@while (${i} < 2000) {@set(t, ${i} * 2)"
+			"@set(i, ${i} + 1)}"
+			"@set(s, \"kept\")@set(a, 1, 2, 3)@set(h.x, \"y\")"
+			"@push(a, 4)@keys(k, ${h})@foreach v (${a}) {}@pop(p, a)";
+		long before = TPT::ObjectArena::getchunkcount();
+		TPT::Symbols s(false);
+		{
+			TPT::IParser p(src, std::strlen(src), s);
+			p.run();
+		}
+		result|= check(6, "chunks after IParser",
+			TPT::ObjectArena::getchunkcount() == before ? "freed" : "held",
+			"freed");
+		result|= check(6, "render s", render("${i} ${s} ${a[0]}${a[2]}"
+			" ${h.x} ${k[0]} ${v} ${p}", s), "2000 kept 13 y x 4 4");
+		TPT::Parser p(src, std::strlen(src), s);
+		p.run();
+		result|= check(6, "chunks after Parser",
+			TPT::ObjectArena::getchunkcount() == before ? "freed" : "held",
+			"freed");
+	}
+
+	return result;
+}